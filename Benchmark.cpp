@@ -0,0 +1,322 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/Socket.h"
+
+// Loopback benchmark of the socket layer. every case connects a TCPSocket to a TCPServer on 127.0.0.1
+// and prints one JSON document, so runs before and after a change can be diffed or plotted.
+//
+// SocketBenchmark [--quick] [--duration ms] [--port n] [--max-clients n] [--out path]
+
+namespace {
+
+	using steady = std::chrono::steady_clock;
+
+	constexpr uint32_t DataType = 1;
+	// ends a stream; the receiver stops reading and the echo server leaves its loop
+	constexpr uint32_t StopType = 2;
+
+	const AES128::cbytearray<16> BenchKey = {'s', 'o', 'c', 'k', 'e', 't', '-', 'b', 'e', 'n', 'c', 'h', 'm', 'a', 'r', 'k'};
+
+	struct Options {
+		std::chrono::milliseconds duration{1000};
+		uint16_t port = 28080;
+		size_t maxclients = 16;
+		size_t iterations = 20000;
+		std::string out;
+		bool quick = false;
+	};
+
+	struct StreamResult {
+		size_t payload = 0;
+		uint64_t packets = 0;
+		uint64_t bytes = 0;
+		double seconds = 0;
+
+		double PacketsPerSecond() const {
+			return seconds > 0 ? static_cast<double>(packets) / seconds : 0;
+		}
+		double GBPerSecond() const {
+			return seconds > 0 ? static_cast<double>(bytes) / seconds / 1e9 : 0;
+		}
+	};
+
+	double Seconds(steady::duration d) {
+		return std::chrono::duration<double>(d).count();
+	}
+
+	// a connected client and the server side of the same connection
+	bool Connect(TCPServer& server, uint16_t port, TCPSocket& client, TCPSocket& peer) {
+		if (!client.Connect(IPAddress("127.0.0.1", port))) {
+			return false;
+		}
+		auto accepted = server.Accept();
+		if (!accepted) {
+			return false;
+		}
+		peer = std::move(*accepted);
+		return true;
+	}
+
+	bool Send(TCPSocket& sock, const Packet& pak, bool encrypted) {
+		return encrypted ? sock.EncryptionSend(pak) : sock.Send(pak);
+	}
+	std::optional<Packet> Recv(TCPSocket& sock, bool encrypted) {
+		return encrypted ? sock.EncryptionRecv() : sock.Recv();
+	}
+
+	// the receiving half of a stream; counts payload bytes until the stop packet
+	StreamResult Drain(TCPSocket& peer, size_t payload, bool encrypted, steady::time_point start) {
+		StreamResult ret;
+		ret.payload = payload;
+		while (auto pak = Recv(peer, encrypted)) {
+			if (pak->GetHeader()->Type == StopType) {
+				break;
+			}
+			++ret.packets;
+			ret.bytes += pak->Payload().size();
+		}
+		ret.seconds = Seconds(steady::now() - start);
+		return ret;
+	}
+
+	/// <summary>
+	/// One client sends payload-sized packets back to back for duration, the server side reads them.
+	/// </summary>
+	StreamResult Stream(TCPServer& server, const Options& opt, size_t payload, bool encrypted) {
+		TCPSocket client, peer;
+		if (!Connect(server, opt.port, client, peer)) {
+			return {};
+		}
+		if (encrypted) {
+			client.CryptEngine.Init(BenchKey);
+			peer.CryptEngine.Init(BenchKey);
+		}
+		Packet data(DataType, Packet::bytearray(payload, 0xa5));
+		Packet stop(StopType, Packet::bytearray(1));
+
+		auto start = steady::now();
+		std::thread sender([&] {
+			auto deadline = start + opt.duration;
+			while (steady::now() < deadline && Send(client, data, encrypted)) {}
+			Send(client, stop, encrypted);
+		});
+		StreamResult ret = Drain(peer, payload, encrypted, start);
+		sender.join();
+		return ret;
+	}
+
+	/// <summary>
+	/// clients connections stream 4 KiB packets at once, each end on a thread of its own.
+	/// </summary>
+	StreamResult Scaling(TCPServer& server, const Options& opt, size_t clients) {
+		constexpr size_t payload = 4096;
+		std::vector<TCPSocket> senders(clients), receivers(clients);
+		for (size_t i = 0; i < clients; ++i) {
+			if (!Connect(server, opt.port, senders[i], receivers[i])) {
+				return {};
+			}
+		}
+		Packet data(DataType, Packet::bytearray(payload, 0xa5));
+		Packet stop(StopType, Packet::bytearray(1));
+		std::vector<StreamResult> results(clients);
+		std::vector<std::thread> threads;
+
+		auto start = steady::now();
+		for (size_t i = 0; i < clients; ++i) {
+			threads.emplace_back([&, i] {
+				auto deadline = start + opt.duration;
+				while (steady::now() < deadline && senders[i].Send(data)) {}
+				senders[i].Send(stop);
+			});
+			threads.emplace_back([&, i] {
+				results[i] = Drain(receivers[i], payload, false, start);
+			});
+		}
+		for (auto&& t : threads) {
+			t.join();
+		}
+
+		StreamResult ret;
+		ret.payload = payload;
+		for (auto&& r : results) {
+			ret.packets += r.packets;
+			ret.bytes += r.bytes;
+			ret.seconds = std::max(ret.seconds, r.seconds);
+		}
+		return ret;
+	}
+
+	/// <summary>
+	/// Ping-pong: the client sends one packet and waits for the echo, iterations times after a warm-up.
+	/// </summary>
+	LatencyHistogram::Snapshot RoundTrip(TCPServer& server, const Options& opt, size_t payload) {
+		LatencyHistogram hist;
+		TCPSocket client, peer;
+		if (!Connect(server, opt.port, client, peer)) {
+			return {};
+		}
+		std::thread echo([&] {
+			while (auto pak = peer.Recv()) {
+				if (pak->GetHeader()->Type == StopType || !peer.Send(*pak)) {
+					break;
+				}
+			}
+		});
+		Packet ping(DataType, Packet::bytearray(payload, 0x5a));
+		size_t warmup = opt.iterations / 10;
+		for (size_t i = 0; i < warmup + opt.iterations; ++i) {
+			auto start = steady::now();
+			if (!client.Send(ping) || !client.Recv()) {
+				break;
+			}
+			if (i >= warmup) {
+				hist.Record(steady::now() - start);
+			}
+		}
+		client.Send(Packet(StopType, Packet::bytearray(1)));
+		echo.join();
+		return hist.Read();
+	}
+
+	// JSON writing
+
+	std::string Number(double value) {
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.6g", value);
+		return buf;
+	}
+	std::string StreamJSON(const StreamResult& r) {
+		return "{\"payload\":" + std::to_string(r.payload) +
+			",\"packets\":" + std::to_string(r.packets) +
+			",\"seconds\":" + Number(r.seconds) +
+			",\"packets_per_sec\":" + Number(r.PacketsPerSecond()) +
+			",\"gb_per_sec\":" + Number(r.GBPerSecond()) + "}";
+	}
+	std::string Join(const std::vector<std::string>& items) {
+		std::string ret = "[";
+		for (size_t i = 0; i < items.size(); ++i) {
+			ret += (i == 0 ? "\n    " : ",\n    ") + items[i];
+		}
+		return ret + (items.empty() ? "]" : "\n  ]");
+	}
+
+	bool Parse(int argc, char** argv, Options& opt) {
+		for (int i = 1; i < argc; ++i) {
+			std::string_view arg = argv[i];
+			bool hasvalue = i + 1 < argc;
+			if (arg == "--quick") {
+				opt.quick = true;
+				opt.duration = std::chrono::milliseconds(200);
+				opt.iterations = 2000;
+				opt.maxclients = std::min<size_t>(opt.maxclients, 4);
+			}
+			else if (arg == "--duration" && hasvalue) {
+				opt.duration = std::chrono::milliseconds(std::stoul(argv[++i]));
+			}
+			else if (arg == "--port" && hasvalue) {
+				opt.port = static_cast<uint16_t>(std::stoul(argv[++i]));
+			}
+			else if (arg == "--max-clients" && hasvalue) {
+				opt.maxclients = std::max<size_t>(1, std::stoul(argv[++i]));
+			}
+			else if (arg == "--out" && hasvalue) {
+				opt.out = argv[++i];
+			}
+			else {
+				std::fprintf(stderr, "usage: %s [--quick] [--duration ms] [--port n] [--max-clients n] [--out path]\n", argv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!Parse(argc, argv, opt)) {
+		return 2;
+	}
+	TCPServer server;
+	if (!server.Listen(opt.port, 1024)) {
+		std::fprintf(stderr, "can not listen on port %u\n", opt.port);
+		return 1;
+	}
+
+	std::vector<size_t> sizes = {16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1 << 20, 4 << 20, 16 << 20};
+	std::vector<std::string> throughput;
+	for (size_t size : sizes) {
+		std::fprintf(stderr, "throughput %zu B\n", size);
+		throughput.push_back(StreamJSON(Stream(server, opt, size, false)));
+	}
+
+	std::vector<std::string> encryption;
+	for (size_t size : {256, 4096, 65536, 1 << 20}) {
+		std::fprintf(stderr, "encryption %zu B\n", size);
+		StreamResult plain = Stream(server, opt, size, false);
+		StreamResult encrypted = Stream(server, opt, size, true);
+		encryption.push_back("{\"payload\":" + std::to_string(size) +
+			",\"plain\":" + StreamJSON(plain) +
+			",\"encrypted\":" + StreamJSON(encrypted) +
+			",\"slowdown\":" + Number(encrypted.GBPerSecond() > 0 ? plain.GBPerSecond() / encrypted.GBPerSecond() : 0) + "}");
+	}
+
+	std::vector<std::string> rtt;
+	for (size_t size : {64, 4096}) {
+		std::fprintf(stderr, "round trip %zu B\n", size);
+		LatencyHistogram::Snapshot h = RoundTrip(server, opt, size);
+		rtt.push_back("{\"payload\":" + std::to_string(size) +
+			",\"iterations\":" + std::to_string(h.count) +
+			",\"mean_us\":" + Number(h.Mean() / 1e3) +
+			",\"p50_us\":" + Number(static_cast<double>(h.Percentile(0.5)) / 1e3) +
+			",\"p99_us\":" + Number(static_cast<double>(h.Percentile(0.99)) / 1e3) +
+			",\"p999_us\":" + Number(static_cast<double>(h.Percentile(0.999)) / 1e3) +
+			",\"max_us\":" + Number(static_cast<double>(h.max) / 1e3) + "}");
+	}
+
+	std::vector<std::string> scaling;
+	for (size_t clients = 1; clients <= opt.maxclients; clients *= 2) {
+		std::fprintf(stderr, "scaling %zu clients\n", clients);
+		StreamResult r = Scaling(server, opt, clients);
+		std::string json = StreamJSON(r);
+		json.insert(1, "\"clients\":" + std::to_string(clients) + ",\"threads\":" + std::to_string(clients * 2) + ",");
+		scaling.push_back(json);
+	}
+
+#ifdef NDEBUG
+	constexpr bool debug = false;
+#else
+	constexpr bool debug = true;
+#endif // NDEBUG
+#ifdef SOCKET_H_ENABLE_TRACE
+	constexpr bool trace = true;
+#else
+	constexpr bool trace = false;
+#endif // SOCKET_H_ENABLE_TRACE
+
+	std::string json = "{\n  \"config\":{\"duration_ms\":" + std::to_string(opt.duration.count()) +
+		",\"iterations\":" + std::to_string(opt.iterations) +
+		",\"quick\":" + (opt.quick ? "true" : "false") +
+		",\"hardware_concurrency\":" + std::to_string(std::thread::hardware_concurrency()) +
+		",\"debug\":" + (debug ? "true" : "false") +
+		",\"trace\":" + (trace ? "true" : "false") + "},\n" +
+		"  \"throughput\":" + Join(throughput) + ",\n" +
+		"  \"encryption\":" + Join(encryption) + ",\n" +
+		"  \"rtt\":" + Join(rtt) + ",\n" +
+		"  \"scaling\":" + Join(scaling) + "\n}\n";
+
+	if (opt.out.empty()) {
+		std::fputs(json.c_str(), stdout);
+		return 0;
+	}
+	std::ofstream ofs(opt.out, std::ios::binary | std::ios::trunc);
+	if (!ofs.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+		std::fprintf(stderr, "can not write %s\n", opt.out.c_str());
+		return 1;
+	}
+	return 0;
+}
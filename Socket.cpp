@@ -194,11 +194,32 @@ void Server() {
 
 	TCPServer server(8080);
 
-	std::map<IPAddress, std::pair<TCPSocket, ClientData>> clients;
+	std::unordered_map<IPAddress, std::pair<TCPSocket, ClientData>> clients;
 	std::vector<std::optional<TCPSocket>> joinqueue;
 	std::deque<TCPSocket*> lostqueue;
 
+	PollSet waitset;
+	LivenessMonitor monitor;
+	TCPBroadcastHub hub;
+	hub.Topic("chat", sharedkey);
+
 	while (true) {
+		waitset.Clear();
+		waitset.Add(server);
+		for (auto&& c : joinqueue) {
+			if (c) {
+				waitset.Add(*c);
+			}
+		}
+		bool buffered = false;
+		for (auto&& [_, pair] : clients) {
+			waitset.Add(pair.first);
+			buffered |= pair.first.HasBufferedPacket();
+			// broadcasts the socket could not take at once
+			pair.first.Flush();
+		}
+		waitset.Wait(buffered ? 0 : -1);
+
 		auto sock = server.Accept();
 
 		if (sock) {
@@ -215,11 +236,13 @@ void Server() {
 			}
 		}
 
-		for (auto&& [_, pair] : clients) {
-			auto&& [c, cd] = pair;
-			if (c.LostConnection()) {
-				lostqueue.push_back(&c);
-				std::cout << "lost connection: " << cd.Name << std::endl;
+		for (auto&& fd : monitor.Poll()) {
+			for (auto&& [_, pair] : clients) {
+				auto&& [c, cd] = pair;
+				if (c.Handle() == fd) {
+					lostqueue.push_back(&c);
+					std::cout << "lost connection: " << cd.Name << std::endl;
+				}
 			}
 		}
 
@@ -240,7 +263,9 @@ void Server() {
 			if (cd) {
 				std::cout << "connected: " << cd->Name << std::endl;
 				auto addr = c->GetPeerAddress();
+				monitor.Watch(*c);
 				clients[*addr] = {std::move(*c), std::move(*cd)};
+				hub.Subscribe("chat", clients[*addr].first);
 				c.reset();
 			}
 		}
@@ -249,6 +274,8 @@ void Server() {
 			auto p = lostqueue.front();
 			lostqueue.pop_front();
 
+			monitor.Unwatch(*p);
+			hub.UnsubscribeAll(*p);
 			clients.erase(*p->GetPeerAddress());
 		}
 
@@ -271,13 +298,8 @@ void Server() {
 
 			std::cout << send << std::endl;
 
-			for (auto&& [_, topair] : clients) {
-				auto&& [oc, __] = topair;
-				if (oc == c) {
-					continue;
-				}
-				oc.EncryptionSend(send);
-			}
+			// encrypted once with the shared key, then the same frame is queued for every other client
+			hub.Publish("chat", Packet(send), &c);
 		}
 	}
 }
@@ -350,12 +372,8 @@ void Client() {
 		if (server.LostConnection()) {
 			break;
 		}
-		
-		if (server.Available() <= 0) {
-			continue;
-		}
 
-		auto pak = server.EncryptionRecv();
+		auto pak = server.EncryptionRecv(100);
 		
 		if (!pak) {
 			continue;
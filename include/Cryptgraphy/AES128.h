@@ -598,6 +598,7 @@ public:
 	}
 	
 	bool CTR(byte_view src, byte_ref dest, size_t length, crypt_t proc) const {
+		trace_scope("AES128::CTR", length);
 
 		size_t c = BlockLength(length);
 
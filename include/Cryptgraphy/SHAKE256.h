@@ -206,6 +206,7 @@ public:
 		return static_cast<bytearray>(A);
 	}
 	static constexpr bytearray SPONGE(const bytearray& N, size_t outlen) {
+		trace_scope("SHAKE256::SPONGE", N.size());
 		constexpr size_t r_8 = r / 8;
 		size_t pad = r_8 - (N.size() % r_8);
 		
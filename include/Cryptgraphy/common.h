@@ -32,6 +32,11 @@ namespace Cryptgraphy {
 
 }
 
+// trace points; Trace.h gives them a body when it is included first with SOCKET_H_ENABLE_TRACE
+#ifndef trace_scope
+#define trace_scope(name, bytes)
+#endif
+
 template<class From>
 	requires
 		std::is_trivially_copyable_v<From> &&
@@ -0,0 +1,332 @@
+#pragma once
+#include "common.h"
+
+/// <summary>
+/// Metrics
+/// </summary>
+
+/// <summary>
+/// Lock-free latency histogram in nanoseconds with HDR-style log-linear buckets: every power of two
+/// is split into SubBuckets linear buckets, so a recorded value is off by at most 1/SubBuckets (12.5%).
+/// Record is a few relaxed atomic adds, safe from any thread; Read copies the counts for reporting.
+/// </summary>
+class LatencyHistogram {
+public:
+	using duration = std::chrono::nanoseconds;
+
+	static constexpr uint32_t SubBucketBits = 3;
+	static constexpr uint32_t SubBuckets = 1u << SubBucketBits;
+	// values from 2^MaxBits ns (about 68 seconds) on land in the last bucket
+	static constexpr uint32_t MaxBits = 36;
+	static constexpr size_t Buckets = (MaxBits - SubBucketBits + 1) * SubBuckets;
+
+	struct Snapshot {
+		std::array<uint64_t, Buckets> counts{};
+		uint64_t count = 0;
+		uint64_t sum = 0;
+		uint64_t max = 0;
+
+		/// <summary>
+		/// Upper edge of the bucket holding the q-th quantile (0.0 - 1.0), never above the largest value. 0 when empty.
+		/// </summary>
+		uint64_t Percentile(double q) const {
+			if (count == 0) {
+				return 0;
+			}
+			uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count)));
+			rank = std::max<uint64_t>(rank, 1);
+			uint64_t seen = 0;
+			for (size_t i = 0; i < Buckets; ++i) {
+				seen += counts[i];
+				if (seen >= rank) {
+					return std::min(UpperBound(i), max);
+				}
+			}
+			return max;
+		}
+		double Mean() const {
+			return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+		}
+		Snapshot& operator+=(const Snapshot& other) {
+			for (size_t i = 0; i < Buckets; ++i) {
+				counts[i] += other.counts[i];
+			}
+			count += other.count;
+			sum += other.sum;
+			max = std::max(max, other.max);
+			return *this;
+		}
+	};
+
+	LatencyHistogram() = default;
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void Record(uint64_t nanoseconds) {
+		m_counts[Index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+		uint64_t max = m_max.load(std::memory_order_relaxed);
+		while (nanoseconds > max && !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {}
+	}
+	void Record(duration elapsed) {
+		Record(static_cast<uint64_t>(std::max<duration::rep>(elapsed.count(), 0)));
+	}
+
+	// the counts are read one by one, so a snapshot taken during Record may be off by the values in flight
+	Snapshot Read() const {
+		Snapshot ret;
+		for (size_t i = 0; i < Buckets; ++i) {
+			ret.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+		}
+		ret.count = m_count.load(std::memory_order_relaxed);
+		ret.sum = m_sum.load(std::memory_order_relaxed);
+		ret.max = m_max.load(std::memory_order_relaxed);
+		return ret;
+	}
+	void Reset() {
+		for (auto&& c : m_counts) {
+			c.store(0, std::memory_order_relaxed);
+		}
+		m_count.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	static constexpr size_t Index(uint64_t value) {
+		value = std::min<uint64_t>(value, (uint64_t(1) << MaxBits) - 1);
+		if (value < SubBuckets) {
+			return static_cast<size_t>(value);
+		}
+		uint32_t shift = static_cast<uint32_t>(std::bit_width(value)) - 1 - SubBucketBits;
+		return static_cast<size_t>((shift + 1) * SubBuckets + ((value >> shift) - SubBuckets));
+	}
+	// largest value counted into bucket index
+	static constexpr uint64_t UpperBound(size_t index) {
+		if (index < SubBuckets) {
+			return index;
+		}
+		uint32_t shift = static_cast<uint32_t>(index / SubBuckets) - 1;
+		uint64_t lower = (SubBuckets + index % SubBuckets) << shift;
+		return lower + (uint64_t(1) << shift) - 1;
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, Buckets> m_counts{};
+	std::atomic<uint64_t> m_count = 0;
+	std::atomic<uint64_t> m_sum = 0;
+	std::atomic<uint64_t> m_max = 0;
+};
+
+/// <summary>
+/// Counters of one connection. every field is a relaxed atomic, so the socket updates them
+/// without locks while another thread reads them; Read gives a plain copy that can be summed and exported.
+/// </summary>
+struct SocketMetrics {
+	using counter_t = std::atomic<uint64_t>;
+
+	counter_t BytesIn = 0;
+	counter_t BytesOut = 0;
+	counter_t PacketsIn = 0;
+	counter_t PacketsOut = 0;
+	// send / recv system calls, those that failed with EAGAIN, and sends that wrote less than asked
+	counter_t SendCalls = 0;
+	counter_t RecvCalls = 0;
+	counter_t WouldBlock = 0;
+	counter_t PartialWrites = 0;
+	counter_t EncryptNanos = 0;
+	counter_t DecryptNanos = 0;
+	// from QueueSend until Flush wrote the last byte of the frame
+	LatencyHistogram SendToFlush;
+	// from the recv that completed a packet until Recv handed it out (decryption included)
+	LatencyHistogram RecvToDispatch;
+
+	struct Snapshot {
+		uint64_t BytesIn = 0;
+		uint64_t BytesOut = 0;
+		uint64_t PacketsIn = 0;
+		uint64_t PacketsOut = 0;
+		uint64_t SendCalls = 0;
+		uint64_t RecvCalls = 0;
+		uint64_t WouldBlock = 0;
+		uint64_t PartialWrites = 0;
+		uint64_t EncryptNanos = 0;
+		uint64_t DecryptNanos = 0;
+		// connections counted: 1 for one socket, the live ones for a MetricsGroup
+		uint64_t Sockets = 0;
+		LatencyHistogram::Snapshot SendToFlush;
+		LatencyHistogram::Snapshot RecvToDispatch;
+
+		Snapshot& operator+=(const Snapshot& other) {
+			BytesIn += other.BytesIn;
+			BytesOut += other.BytesOut;
+			PacketsIn += other.PacketsIn;
+			PacketsOut += other.PacketsOut;
+			SendCalls += other.SendCalls;
+			RecvCalls += other.RecvCalls;
+			WouldBlock += other.WouldBlock;
+			PartialWrites += other.PartialWrites;
+			EncryptNanos += other.EncryptNanos;
+			DecryptNanos += other.DecryptNanos;
+			Sockets += other.Sockets;
+			SendToFlush += other.SendToFlush;
+			RecvToDispatch += other.RecvToDispatch;
+			return *this;
+		}
+
+		/// <summary>
+		/// Prometheus text exposition: counters as prefix_*_total, the histograms as summaries in seconds.
+		/// labels is inserted into every sample as is, e.g. R"(server="chat")".
+		/// </summary>
+		std::string Prometheus(std::string_view prefix = "socket", std::string_view labels = "") const {
+			std::string ret;
+			auto sample = [&](std::string_view name, std::string_view extra, const char* value) {
+				ret.append(prefix).append("_").append(name);
+				if (!labels.empty() || !extra.empty()) {
+					ret.append("{").append(labels);
+					if (!labels.empty() && !extra.empty()) {
+						ret.append(",");
+					}
+					ret.append(extra).append("}");
+				}
+				ret.append(" ").append(value).append("\n");
+			};
+			auto type = [&](std::string_view name, std::string_view kind) {
+				ret.append("# TYPE ").append(prefix).append("_").append(name).append(" ").append(kind).append("\n");
+			};
+			auto counter = [&](std::string_view name, uint64_t value) {
+				type(name, "counter");
+				sample(name, "", std::to_string(value).c_str());
+			};
+			auto seconds = [](uint64_t nanoseconds) {
+				std::array<char, 32> buf{};
+				std::snprintf(buf.data(), buf.size(), "%.9g", static_cast<double>(nanoseconds) * 1e-9);
+				return buf;
+			};
+			auto summary = [&](std::string_view name, const LatencyHistogram::Snapshot& h) {
+				type(name, "summary");
+				static constexpr std::pair<const char*, double> quantiles[] = {{"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999}};
+				for (auto&& [label, q] : quantiles) {
+					sample(name, std::string("quantile=\"") + label + "\"", seconds(h.Percentile(q)).data());
+				}
+				std::string base(name);
+				sample(base + "_sum", "", seconds(h.sum).data());
+				sample(base + "_count", "", std::to_string(h.count).c_str());
+			};
+
+			counter("received_bytes_total", BytesIn);
+			counter("sent_bytes_total", BytesOut);
+			counter("received_packets_total", PacketsIn);
+			counter("sent_packets_total", PacketsOut);
+			counter("send_calls_total", SendCalls);
+			counter("recv_calls_total", RecvCalls);
+			counter("would_block_total", WouldBlock);
+			counter("partial_writes_total", PartialWrites);
+			type("encrypt_seconds_total", "counter");
+			sample("encrypt_seconds_total", "", seconds(EncryptNanos).data());
+			type("decrypt_seconds_total", "counter");
+			sample("decrypt_seconds_total", "", seconds(DecryptNanos).data());
+			type("sockets", "gauge");
+			sample("sockets", "", std::to_string(Sockets).c_str());
+			summary("send_to_flush_seconds", SendToFlush);
+			summary("recv_to_dispatch_seconds", RecvToDispatch);
+			return ret;
+		}
+	};
+
+	Snapshot Read() const {
+		Snapshot ret;
+		ret.BytesIn = BytesIn.load(std::memory_order_relaxed);
+		ret.BytesOut = BytesOut.load(std::memory_order_relaxed);
+		ret.PacketsIn = PacketsIn.load(std::memory_order_relaxed);
+		ret.PacketsOut = PacketsOut.load(std::memory_order_relaxed);
+		ret.SendCalls = SendCalls.load(std::memory_order_relaxed);
+		ret.RecvCalls = RecvCalls.load(std::memory_order_relaxed);
+		ret.WouldBlock = WouldBlock.load(std::memory_order_relaxed);
+		ret.PartialWrites = PartialWrites.load(std::memory_order_relaxed);
+		ret.EncryptNanos = EncryptNanos.load(std::memory_order_relaxed);
+		ret.DecryptNanos = DecryptNanos.load(std::memory_order_relaxed);
+		ret.Sockets = 1;
+		ret.SendToFlush = SendToFlush.Read();
+		ret.RecvToDispatch = RecvToDispatch.Read();
+		return ret;
+	}
+
+	static void Add(counter_t& counter, uint64_t value) {
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+	// accounts one send call that was asked to write requested bytes and returned ret
+	void Sent(int ret, size_t requested, bool wouldblock) {
+		Add(SendCalls, 1);
+		if (ret >= 0) {
+			Add(BytesOut, static_cast<uint64_t>(ret));
+			if (static_cast<size_t>(ret) < requested) {
+				Add(PartialWrites, 1);
+			}
+		}
+		else if (wouldblock) {
+			Add(WouldBlock, 1);
+		}
+	}
+	void Received(int ret, bool wouldblock) {
+		Add(RecvCalls, 1);
+		if (ret > 0) {
+			Add(BytesIn, static_cast<uint64_t>(ret));
+		}
+		else if (ret < 0 && wouldblock) {
+			Add(WouldBlock, 1);
+		}
+	}
+};
+
+/// <summary>
+/// Sums the metrics of many connections, e.g. everything a server accepted. copies share the same group.
+/// Attach hands out the metrics of one connection; when the connection drops them, their totals are
+/// folded into the group, so the counters of a group never go backwards.
+/// </summary>
+class MetricsGroup {
+public:
+
+	MetricsGroup() : m_state(std::make_shared<State>()) {}
+
+	std::shared_ptr<SocketMetrics> Attach() const {
+		std::shared_ptr<SocketMetrics> metrics(new SocketMetrics(), [state = m_state](SocketMetrics* p) {
+			SocketMetrics::Snapshot last = p->Read();
+			std::lock_guard<std::mutex> lock(state->mutex);
+			state->retired += last;
+			std::erase(state->live, p);
+			delete p;
+		});
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		m_state->live.push_back(metrics.get());
+		return metrics;
+	}
+
+	// the live connections are read under the lock that keeps them from retiring meanwhile
+	SocketMetrics::Snapshot Read() const {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		SocketMetrics::Snapshot ret = m_state->retired;
+		for (const SocketMetrics* metrics : m_state->live) {
+			ret += metrics->Read();
+		}
+		ret.Sockets = m_state->live.size();
+		return ret;
+	}
+	std::string Prometheus(std::string_view prefix = "socket", std::string_view labels = "") const {
+		return Read().Prometheus(prefix, labels);
+	}
+	size_t Sockets() const {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return m_state->live.size();
+	}
+
+private:
+
+	struct State {
+		std::mutex mutex;
+		SocketMetrics::Snapshot retired;
+		std::vector<const SocketMetrics*> live;
+	};
+
+	std::shared_ptr<State> m_state;
+};
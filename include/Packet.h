@@ -29,6 +29,25 @@ struct Header {
 		return Type == type_hash_code<T>();
 	}
 
+	// request / response correlation used by RpcChannel: _reserved_field[0] carries the request id
+	// (0 = not a call) and bit 0 of _reserved_field[1] marks a response
+	static constexpr uint32_t ResponseFlag = 1;
+
+	uint32_t RequestID() const {
+		return _reserved_field[0];
+	}
+	Header& RequestID(uint32_t id) {
+		_reserved_field[0] = id;
+		return *this;
+	}
+	bool IsResponse() const {
+		return (_reserved_field[1] & ResponseFlag) != 0;
+	}
+	Header& Response(bool flag = true) {
+		_reserved_field[1] = flag ? (_reserved_field[1] | ResponseFlag) : (_reserved_field[1] & ~ResponseFlag);
+		return *this;
+	}
+
 	template <typename T>
 	static constexpr std::string_view type_name() {
 #if defined(__clang__) || defined(__GNUC__)
@@ -202,19 +221,25 @@ struct Packet {
 			return;
 		}
 
-		std::istreambuf_iterator<char> begin(ifs);
-		std::istreambuf_iterator<char> end;
+		// seekable streams are read straight into the packet; anything else falls back to a sequential read
+		std::streampos begin = ifs.tellg();
+		ifs.seekg(0, std::ios::end);
+		std::streampos end = ifs.tellg();
+		ifs.seekg(begin);
 
-		std::string data(begin, end);
+		if (begin == std::streampos(-1) || end == std::streampos(-1)) {
+			ifs.clear();
+			std::string data{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+			*this = Packet(id, data);
+			return;
+		}
 
-		*this = Packet(id, data);
+		ReadFrom(id, ifs, static_cast<uint64_t>(end - begin));
 	}
 	template<class enumT>
 	Packet(enumT type, std::ifstream& ifs) requires (is_enum32<enumT>) : Packet(static_cast<uint32_t>(type), ifs) {}
 	explicit Packet(std::ifstream& ifs) : Packet(Header::type_hash_code<FILE>(), ifs) {}
 
-	/*
-	
 	explicit Packet(uint32_t id, const std::filesystem::path& path) {
 		std::error_code ec;
 		if (path.empty() || !std::filesystem::exists(path, ec) || ec) {
@@ -232,26 +257,29 @@ struct Packet {
 			return;
 		}
 
-		buf_t data(size);
-		ifs.read(reinterpret_cast<char*>(data.data()), size);
-
-		ifs.close();
-
-		*this = Packet(id, data);
+		ReadFrom(id, ifs, size);
 	}
 	template<class enumT>
-	explicit Packet(enumT type, const std::filesystem::path& path, Header::enum32<enumT> dummy_0 = {}) : Packet(static_cast<uint32_t>(type), path) {}
+	explicit Packet(enumT type, const std::filesystem::path& path) requires (is_enum32<enumT>) : Packet(static_cast<uint32_t>(type), path) {}
 	explicit Packet(const std::filesystem::path& path) : Packet(Header::type_hash_code<FILE>(), path) {}
 	
-	*/
 	
 	size_t Size() const { return m_buffer.size(); }
 
 	const bytearray& GetBuffer() const { return m_buffer; }
+	byte_view Payload() const {
+		if (CheckHeader(0)) {
+			return {};
+		}
+		return byte_view(m_buffer).subspan(HeaderSize);
+	}
 	Packet& SetBuffer(bytearray&& src) {
 		m_buffer = std::move(src);
 		return *this;
 	}
+	bytearray ReleaseBuffer() {
+		return std::exchange(m_buffer, bytearray{});
+	}
 
 	std::optional<Header> GetHeader() const {
 		if (CheckHeader(0)) {
@@ -261,6 +289,15 @@ struct Packet {
 		std::memcpy(&ret, m_buffer.data(), HeaderSize);
 		return ret;
 	}
+	// overwrites the header fields in place; Size keeps describing the current payload
+	bool SetHeader(Header head) {
+		if (CheckHeader(0)) {
+			return false;
+		}
+		head.Size = static_cast<uint32_t>(m_buffer.size() - HeaderSize);
+		std::memcpy(m_buffer.data(), &head, HeaderSize);
+		return true;
+	}
 
 	template<class T>
 	std::optional<T> Get() const requires (memcpyable<T> && !from_byteable<T>) {
@@ -436,6 +473,59 @@ struct Packet {
 
 private:
 
+	// reads size bytes of ifs behind the header in one go. payloads over 4GiB do not fit Header::Size
+	void ReadFrom(uint32_t id, std::ifstream& ifs, uint64_t size) {
+		if (size > UINT32_MAX) {
+			return;
+		}
+		Header head(id);
+		head.Size = static_cast<uint32_t>(size);
+		m_buffer.resize(HeaderSize + head.Size);
+		std::memcpy(m_buffer.data(), std::addressof(head), HeaderSize);
+		if (!ifs.read(reinterpret_cast<char*>(m_buffer.data() + HeaderSize), head.Size)) {
+			m_buffer.clear();
+		}
+	}
+
 	bytearray m_buffer{};
 
 };
+
+/// <summary>
+/// File Packet
+/// </summary>
+
+/// <summary>
+/// Packet whose payload stays in a file. only the header is kept in memory and the sockets stream the
+/// payload from the file (sendfile on linux), so it always travels unencrypted.
+/// the file must not shrink while it is being sent.
+/// </summary>
+struct FilePacket {
+
+	FilePacket() {}
+	FilePacket(uint32_t id, std::filesystem::path path) : m_header(id), m_path(std::move(path)) {
+		std::error_code ec;
+		const auto size = std::filesystem::file_size(m_path, ec);
+		if (ec || size > UINT32_MAX) {
+			return;
+		}
+		m_header.Size = static_cast<uint32_t>(size);
+		m_valid = true;
+	}
+	template<class enumT>
+	FilePacket(enumT type, std::filesystem::path path) requires (SocketDetail::enum32<enumT>) : FilePacket(static_cast<uint32_t>(type), std::move(path)) {}
+	explicit FilePacket(std::filesystem::path path) : FilePacket(Header::type_hash_code<FILE>(), std::move(path)) {}
+
+	bool IsValid() const { return m_valid; }
+	const Header& GetHeader() const { return m_header; }
+	const std::filesystem::path& Path() const { return m_path; }
+	// whole frame on the wire, like Packet::Size()
+	size_t Size() const { return Packet::HeaderSize + m_header.Size; }
+
+private:
+
+	Header m_header{};
+	std::filesystem::path m_path{};
+	bool m_valid = false;
+
+};
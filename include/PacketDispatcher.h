@@ -0,0 +1,249 @@
+#pragma once
+#include "common.h"
+#include "Packet.h"
+
+/// <summary>
+/// Packet Dispatcher
+/// </summary>
+
+/// <summary>
+/// Calls the handler registered for Header::Type of a packet, with the payload deserialized by Packet::Get
+/// into the handler's first parameter (or the Packet itself when that parameter is a Packet).
+/// handlers are kept in a flat table: indexed by Type - base when the registered types are dense
+/// (enum values), otherwise by a multiplicative perfect hash found at registration (type_hash_code ids).
+/// a dispatch is one table load, a compare and one call through a function pointer: no virtual call, no map lookup.
+/// Context... are extra arguments handed to every handler, e.g. the socket the packet came from.
+/// </summary>
+template<class... Context>
+class PacketDispatcher {
+public:
+
+	// handlers receive (Arg, Context...) and return void, or bool to report failure
+	using fallback_t = std::function<void(const Packet&, Context...)>;
+
+	PacketDispatcher() = default;
+
+	PacketDispatcher(const PacketDispatcher&) = delete;
+	PacketDispatcher& operator=(const PacketDispatcher&) = delete;
+	PacketDispatcher(PacketDispatcher&&) = default;
+	PacketDispatcher& operator=(PacketDispatcher&&) = default;
+
+	/// <summary>
+	/// Registers f for packets made from T (Header::type_hash_code&lt;T&gt;()). replaces an earlier handler.
+	/// returns false when no collision-free table could be built.
+	/// </summary>
+	template<class T, class F>
+	bool On(F&& f) {
+		return Register<typename FirstArg<std::decay_t<F>, T>::type>(Header::type_hash_code<T>(), std::forward<F>(f));
+	}
+	template<class F>
+	bool On(uint32_t type, F&& f) {
+		return Register<typename FirstArg<std::decay_t<F>, Packet>::type>(type, std::forward<F>(f));
+	}
+	template<SocketDetail::enum32 E, class F>
+	bool On(E type, F&& f) {
+		return On(static_cast<uint32_t>(type), std::forward<F>(f));
+	}
+	// called for types without a handler
+	void Otherwise(fallback_t f) {
+		m_fallback = std::move(f);
+	}
+	bool Remove(uint32_t type) {
+		size_t erased = std::erase_if(m_entries, [type](const Entry& entry) { return entry.type == type; });
+		return erased != 0 && Build();
+	}
+
+	/// <summary>
+	/// Runs the handler for pak. false when the packet is malformed, no handler (nor fallback) exists,
+	/// the payload does not deserialize into the handler's argument, or the handler returned false.
+	/// </summary>
+	bool Dispatch(const Packet& pak, Context... ctx) const {
+		auto head = pak.GetHeader();
+		if (!head) {
+			return false;
+		}
+		if (const Slot* slot = Find(head->Type)) {
+			return slot->thunk(slot->handler, pak, ctx...);
+		}
+		if (m_fallback) {
+			m_fallback(pak, ctx...);
+			return true;
+		}
+		return false;
+	}
+	bool operator()(const Packet& pak, Context... ctx) const {
+		return Dispatch(pak, ctx...);
+	}
+
+	bool Contains(uint32_t type) const {
+		return Find(type) != nullptr;
+	}
+	size_t Size() const {
+		return m_entries.size();
+	}
+	// true while the table is indexed directly by Type - base
+	bool IsDense() const {
+		return m_dense;
+	}
+
+private:
+
+	using thunk_t = bool(*)(void*, const Packet&, Context...);
+
+	struct Slot {
+		uint32_t type = 0;
+		thunk_t thunk = nullptr;
+		void* handler = nullptr;
+	};
+	struct Entry {
+		uint32_t type;
+		thunk_t thunk;
+		std::shared_ptr<void> handler;
+	};
+
+	// dense tables may waste up to this many empty slots per handler
+	static constexpr size_t DenseFactor = 4;
+	static constexpr size_t DenseMinimum = 64;
+	static constexpr uint32_t MaxHashBits = 20;
+	static constexpr size_t HashAttempts = 256;
+
+	// first parameter of a handler; Fallback for generic lambdas and handlers without parameters
+	template<class F, class Fallback, class = void>
+	struct FirstArg {
+		using type = Fallback;
+	};
+	template<class F, class Fallback>
+	struct FirstArg<F, Fallback, std::void_t<decltype(&F::operator())>> : FirstArg<decltype(&F::operator()), Fallback> {};
+	template<class R, class C, class A, class... Rest, class Fallback>
+	struct FirstArg<R(C::*)(A, Rest...) const, Fallback> {
+		using type = std::decay_t<A>;
+	};
+	template<class R, class C, class A, class... Rest, class Fallback>
+	struct FirstArg<R(C::*)(A, Rest...), Fallback> {
+		using type = std::decay_t<A>;
+	};
+	template<class R, class A, class... Rest, class Fallback>
+	struct FirstArg<R(*)(A, Rest...), Fallback> {
+		using type = std::decay_t<A>;
+	};
+
+	template<class Arg, class F>
+	static bool Invoke(void* handler, const Packet& pak, Context... ctx) {
+		F& f = *static_cast<F*>(handler);
+		if constexpr (std::is_same_v<Arg, Packet>) {
+			return Call(f, pak, ctx...);
+		}
+		else {
+			std::optional<Arg> value = pak.template Get<Arg>();
+			if (!value) {
+				return false;
+			}
+			return Call(f, std::move(*value), ctx...);
+		}
+	}
+	template<class F, class A>
+	static bool Call(F& f, A&& arg, Context... ctx) {
+		if constexpr (std::is_same_v<std::invoke_result_t<F&, A&&, Context...>, bool>) {
+			return f(std::forward<A>(arg), ctx...);
+		}
+		else {
+			f(std::forward<A>(arg), ctx...);
+			return true;
+		}
+	}
+
+	template<class Arg, class F>
+	bool Register(uint32_t type, F&& f) {
+		using handler_t = std::decay_t<F>;
+		Entry entry{type, &Invoke<Arg, handler_t>, std::make_shared<handler_t>(std::forward<F>(f))};
+		auto it = std::find_if(m_entries.begin(), m_entries.end(), [type](const Entry& e) { return e.type == type; });
+		std::optional<Entry> previous;
+		if (it != m_entries.end()) {
+			previous = std::exchange(*it, std::move(entry));
+		}
+		else {
+			m_entries.push_back(std::move(entry));
+		}
+		if (Build()) {
+			return true;
+		}
+		// keep the table that worked
+		if (previous) {
+			*std::find_if(m_entries.begin(), m_entries.end(), [type](const Entry& e) { return e.type == type; }) = std::move(*previous);
+		}
+		else {
+			m_entries.pop_back();
+		}
+		Build();
+		return false;
+	}
+
+	const Slot* Find(uint32_t type) const {
+		// below base the subtraction wraps past the end of the table
+		size_t index = m_dense ? static_cast<size_t>(type - m_base) : static_cast<size_t>(static_cast<uint32_t>(type * m_multiplier) >> m_shift);
+		if (index >= m_table.size()) {
+			return nullptr;
+		}
+		const Slot& slot = m_table[index];
+		return slot.thunk != nullptr && slot.type == type ? &slot : nullptr;
+	}
+
+	bool Build() {
+		m_table.clear();
+		m_dense = true;
+		m_base = 0;
+		if (m_entries.empty()) {
+			return true;
+		}
+		auto [lo, hi] = std::minmax_element(m_entries.begin(), m_entries.end(), [](const Entry& l, const Entry& r) { return l.type < r.type; });
+		uint64_t span = static_cast<uint64_t>(hi->type) - lo->type + 1;
+		if (span <= std::max(DenseMinimum, m_entries.size() * DenseFactor)) {
+			m_base = lo->type;
+			m_table.resize(static_cast<size_t>(span));
+			for (auto&& entry : m_entries) {
+				m_table[entry.type - m_base] = Slot{entry.type, entry.thunk, entry.handler.get()};
+			}
+			return true;
+		}
+
+		m_dense = false;
+		uint64_t seed = 0x9e3779b97f4a7c15ULL;
+		for (uint32_t bits = std::bit_width(m_entries.size()) + 1; bits <= MaxHashBits; ++bits) {
+			std::vector<Slot> table(size_t(1) << bits);
+			for (size_t attempt = 0; attempt < HashAttempts; ++attempt) {
+				uint32_t multiplier = static_cast<uint32_t>(SplitMix(seed)) | 1u;
+				std::fill(table.begin(), table.end(), Slot{});
+				bool collision = false;
+				for (auto&& entry : m_entries) {
+					Slot& slot = table[static_cast<uint32_t>(entry.type * multiplier) >> (32 - bits)];
+					if (slot.thunk != nullptr) {
+						collision = true;
+						break;
+					}
+					slot = Slot{entry.type, entry.thunk, entry.handler.get()};
+				}
+				if (!collision) {
+					m_table = std::move(table);
+					m_multiplier = multiplier;
+					m_shift = 32 - bits;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	static uint64_t SplitMix(uint64_t& state) {
+		uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	std::vector<Entry> m_entries;
+	std::vector<Slot> m_table;
+	bool m_dense = true;
+	uint32_t m_base = 0;
+	uint32_t m_multiplier = 1;
+	uint32_t m_shift = 31;
+	fallback_t m_fallback;
+};
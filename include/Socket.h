@@ -5,27 +5,54 @@
 #define NOMINMAX
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <afunix.h>
 #include <windows.h>
 #pragma comment(lib,"ws2_32.lib")
 #endif // _WINDOWS_
 #else
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <poll.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/errqueue.h>
+#endif // __linux__
 #endif // _MSC_BUILD
 
+// SOCKET_H_USE_IO_URING compiles in IOUring / URingSocketBase where the kernel headers provide them.
+// the default transport stays SocketBase; pass URingSocketBase as sockbase to opt in
+#if defined(SOCKET_H_USE_IO_URING) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define SOCKET_H_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
 #include "common.h"
 
 #ifdef SOCKET_H_USE_NAMESPACE
 namespace NetIO {
 #endif // SOCKET_H_USE_NAMESPACE
 
+#include "Trace.h"
 #include "Cryptgraphy/AES128.h"
 #include "Packet.h"
+#include "TimerWheel.h"
+#include "PacketDispatcher.h"
+#include "Metrics.h"
 
 /// <summary>
 /// Debug Utility
@@ -63,6 +90,9 @@ enum class Protocol : int {
 /// IPAddress
 /// </summary>
 
+template<class ipT>
+class basic_Resolver;
+
 template<IPVersion _type>
 struct IPAddressBase {
 	constexpr static int VersionValue = static_cast<int>(_type);
@@ -124,6 +154,10 @@ struct IPAddressBase {
 	operator struct sockaddr* () {
 		return reinterpret_cast<struct sockaddr*>(&address);
 	}
+	// address length for bind / connect
+	socklen_t Length() const {
+		return sizeof(address_t);
+	}
 
 	IPAddressBase& Address(const std::string& addr) {
 		int ret = inet_pton(VersionValue, addr.c_str(), &((&address)->*AddressPtr()));
@@ -156,12 +190,55 @@ struct IPAddressBase {
 		return static_cast<int>(addr->sa_family);
 	}
 
-	friend bool operator==(const IPAddressBase& lhs, const IPAddressBase& rhs) { return lhs.Address() == rhs.Address(); }
-	friend bool operator!=(const IPAddressBase& lhs, const IPAddressBase& rhs) { return lhs.Address() != rhs.Address(); }
-	friend bool operator<(const IPAddressBase& lhs, const IPAddressBase& rhs) { return lhs.Address() < rhs.Address(); }
-	friend bool operator<=(const IPAddressBase& lhs, const IPAddressBase& rhs) { return lhs.Address() <= rhs.Address(); }
-	friend bool operator>(const IPAddressBase& lhs, const IPAddressBase& rhs) { return lhs.Address() > rhs.Address(); }
-	friend bool operator>=(const IPAddressBase& lhs, const IPAddressBase& rhs) { return lhs.Address() >= rhs.Address(); }
+	/// <summary>
+	/// Raw address bytes in network order (4 for IPv4, 16 for IPv6), without the port.
+	/// </summary>
+	SocketDetail::byte_view AddressBytes() const {
+		const auto& addr = (&address)->*AddressPtr();
+		return SocketDetail::byte_view(reinterpret_cast<const SocketDetail::byte_t*>(&addr), sizeof(addr));
+	}
+
+	/// <summary>
+	/// Three-way comparison of the raw bytes (numeric order of the address). the port breaks ties only with withport.
+	/// </summary>
+	static int Compare(const IPAddressBase& lhs, const IPAddressBase& rhs, bool withport = false) {
+		SocketDetail::byte_view l = lhs.AddressBytes();
+		int ret = std::memcmp(l.data(), rhs.AddressBytes().data(), l.size());
+		if (ret != 0 || !withport) {
+			return ret;
+		}
+		return static_cast<int>(lhs.Port()) - static_cast<int>(rhs.Port());
+	}
+	// FNV-1a over the address bytes (and the port with withport); equal addresses hash equal
+	size_t Hash(bool withport = false) const {
+		uint64_t hash = 14695981039346656037ULL;
+		auto mix = [&](SocketDetail::byte_view bytes) {
+			for (auto b : bytes) {
+				hash = (hash ^ b) * 1099511628211ULL;
+			}
+		};
+		mix(AddressBytes());
+		if (withport) {
+			const auto& port = (&address)->*PortPtr();
+			mix(SocketDetail::byte_view(reinterpret_cast<const SocketDetail::byte_t*>(&port), sizeof(port)));
+		}
+		return static_cast<size_t>(hash);
+	}
+
+	// hasher / key_equal for containers keyed by address and port (the operators ignore the port)
+	struct PortHash {
+		size_t operator()(const IPAddressBase& addr) const noexcept { return addr.Hash(true); }
+	};
+	struct PortEqual {
+		bool operator()(const IPAddressBase& lhs, const IPAddressBase& rhs) const noexcept { return Compare(lhs, rhs, true) == 0; }
+	};
+
+	friend bool operator==(const IPAddressBase& lhs, const IPAddressBase& rhs) { return Compare(lhs, rhs) == 0; }
+	friend bool operator!=(const IPAddressBase& lhs, const IPAddressBase& rhs) { return Compare(lhs, rhs) != 0; }
+	friend bool operator<(const IPAddressBase& lhs, const IPAddressBase& rhs) { return Compare(lhs, rhs) < 0; }
+	friend bool operator<=(const IPAddressBase& lhs, const IPAddressBase& rhs) { return Compare(lhs, rhs) <= 0; }
+	friend bool operator>(const IPAddressBase& lhs, const IPAddressBase& rhs) { return Compare(lhs, rhs) > 0; }
+	friend bool operator>=(const IPAddressBase& lhs, const IPAddressBase& rhs) { return Compare(lhs, rhs) >= 0; }
 	
 	static IPAddressBase Any() {
 		return
@@ -176,17 +253,42 @@ struct IPAddressBase {
 					IPAddressBase()));
 	}
 
+	/// <summary>
+	/// Numeric literals are parsed in place; names go through the shared resolver cache
+	/// (basic_Resolver::Default()), which blocks only on a cache miss.
+	/// </summary>
 	static std::optional<IPAddressBase> SolveHostName(const std::string& hostname, Protocol protocol = Protocol::TCP) {
+		if (auto ret = FromNumeric(hostname)) {
+			return ret;
+		}
+		return basic_Resolver<IPAddressBase>::Default().Resolve(hostname, protocol);
+	}
+	// parses a numeric address with inet_pton; never touches the resolver
+	static std::optional<IPAddressBase> FromNumeric(const std::string& host) {
+		IPAddressBase ret;
+		if (inet_pton(VersionValue, host.c_str(), &((&ret.address)->*AddressPtr())) != 1) {
+			return std::nullopt;
+		}
+		return ret;
+	}
+	/// <summary>
+	/// Blocking, uncached getaddrinfo keeping every result.
+	/// </summary>
+	static std::vector<IPAddressBase> Lookup(const std::string& hostname, Protocol protocol = Protocol::TCP) {
+		std::vector<IPAddressBase> ret;
 		struct addrinfo hints = {};
 		hints.ai_family = VersionValue;
 		hints.ai_socktype = static_cast<int>(protocol);
 		struct addrinfo* res;
 		if (getaddrinfo(hostname.c_str(), nullptr, &hints, &res) != 0) {
 			dbg_print();
-			return std::nullopt;
+			return ret;
+		}
+		for (struct addrinfo* it = res; it != nullptr; it = it->ai_next) {
+			IPAddressBase addr;
+			addr.address = *reinterpret_cast<address_t*>(it->ai_addr);
+			ret.push_back(addr);
 		}
-		IPAddressBase ret;
-		ret.address = *reinterpret_cast<address_t*>(res->ai_addr);
 		freeaddrinfo(res);
 		return ret;
 	}
@@ -196,6 +298,93 @@ protected:
 };
 
 
+/// <summary>
+/// Local (AF_UNIX) address
+/// </summary>
+
+/// <summary>
+/// Path of a unix domain socket. plugs into the ipT parameter of SocketBase, basic_TCPSocket and basic_TCPServer,
+/// so peers on the same host exchange the same Packet frames without the TCP/IP loopback stack.
+/// a leading '@' names a linux abstract socket, which leaves no file behind.
+/// </summary>
+struct UnixAddress {
+	constexpr static int VersionValue = AF_UNIX;
+	constexpr static bool IsIPv4 = false;
+	constexpr static bool IsIPv6 = false;
+
+	using address_t = struct sockaddr_un;
+
+	static constexpr size_t MaxPath = sizeof(address_t::sun_path) - 1;
+
+	UnixAddress() { address.sun_family = AF_UNIX; }
+	UnixAddress(const std::string& path) : UnixAddress() { Path(path); }
+	UnixAddress(const char* path) : UnixAddress(std::string(path)) {}
+	UnixAddress(const address_t& addr) : address(addr) {}
+
+	operator struct sockaddr* () {
+		return reinterpret_cast<struct sockaddr*>(&address);
+	}
+	// address length for bind / connect: the family and the path only. an abstract name is all of its
+	// bytes up to this length, so trailing zeros would be part of it
+	socklen_t Length() const {
+		size_t path = IsAbstract() ? 1 + ::strnlen(address.sun_path + 1, MaxPath) : ::strnlen(address.sun_path, sizeof(address.sun_path));
+		return static_cast<socklen_t>(offsetof(address_t, sun_path) + path);
+	}
+
+	// paths longer than MaxPath are rejected and leave the address empty
+	UnixAddress& Path(const std::string& path) {
+		std::memset(address.sun_path, 0, sizeof(address.sun_path));
+		if (path.size() > MaxPath) {
+			dbg_print();
+			return *this;
+		}
+		std::memcpy(address.sun_path, path.data(), path.size());
+		if (!path.empty() && path[0] == '@') {
+			address.sun_path[0] = '\0';
+		}
+		return *this;
+	}
+	std::string Path() const {
+		if (IsAbstract()) {
+			return '@' + std::string(address.sun_path + 1, ::strnlen(address.sun_path + 1, MaxPath));
+		}
+		return std::string(address.sun_path, ::strnlen(address.sun_path, sizeof(address.sun_path)));
+	}
+	bool IsAbstract() const {
+		return address.sun_path[0] == '\0' && address.sun_path[1] != '\0';
+	}
+	/// <summary>
+	/// Removes the socket file a previous listener left at the path; bind fails while it exists.
+	/// </summary>
+	bool Unlink() const {
+		std::error_code ec;
+		return !IsAbstract() && std::filesystem::remove(Path(), ec);
+	}
+
+	SocketDetail::byte_view AddressBytes() const {
+		return SocketDetail::byte_view(reinterpret_cast<const SocketDetail::byte_t*>(address.sun_path), sizeof(address.sun_path));
+	}
+	static int Compare(const UnixAddress& lhs, const UnixAddress& rhs) {
+		return std::memcmp(lhs.address.sun_path, rhs.address.sun_path, sizeof(address.sun_path));
+	}
+	// FNV-1a over the path, consistent with Compare
+	size_t Hash() const {
+		uint64_t hash = 14695981039346656037ULL;
+		for (auto b : AddressBytes()) {
+			hash = (hash ^ b) * 1099511628211ULL;
+		}
+		return static_cast<size_t>(hash);
+	}
+
+	friend bool operator==(const UnixAddress& lhs, const UnixAddress& rhs) { return Compare(lhs, rhs) == 0; }
+	friend bool operator!=(const UnixAddress& lhs, const UnixAddress& rhs) { return Compare(lhs, rhs) != 0; }
+	friend bool operator<(const UnixAddress& lhs, const UnixAddress& rhs) { return Compare(lhs, rhs) < 0; }
+
+protected:
+	address_t address{};
+};
+
+
 #ifdef _MSC_BUILD
 
 /// <summary>
@@ -234,18 +423,10 @@ public:
 
 
 /// <summary>
-/// Socket Base
+/// Socket Traits
 /// </summary>
 
-template<class ipT, Protocol _protocol>
-class SocketBase {
-public:
-	using IPType = ipT;
-
-	using bytearray = SocketDetail::bytearray;
-
-	template<class T>
-	static constexpr bool memcpyable = SocketDetail::memcpyable<T>;
+struct SocketTraits {
 
 	// using poll_t;
 #ifdef _MSC_BUILD
@@ -261,6 +442,279 @@ public:
 	using sock_t = int;
 #endif // _MSC_BUILD
 
+	static sock_t InValidSocket() {
+#ifdef _MSC_BUILD
+		return INVALID_SOCKET;
+#else
+		return -1;
+#endif
+	}
+
+	static void CloseSocket(sock_t s) {
+#ifdef _MSC_BUILD
+		closesocket(s);
+#else
+		close(s);
+#endif
+	}
+
+	static void NonBlocking(sock_t s, bool flag = true) {
+#ifdef _MSC_BUILD
+		u_long mode = flag ? 1 : 0;
+		ioctlsocket(s, FIONBIO, &mode);
+#else
+		int flags = fcntl(s, F_GETFL, 0);
+		fcntl(s, F_SETFL, flag ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+	}
+	// winsock can not query the mode, so sockets there are reported as blocking
+	static bool IsNonBlocking(sock_t s) {
+#ifdef _MSC_BUILD
+		return false;
+#else
+		return (fcntl(s, F_GETFL, 0) & O_NONBLOCK) != 0;
+#endif
+	}
+
+	// per-call non-blocking flag for send / recv. winsock has none, so sockets there must be _NonBlocking()
+#ifdef _MSC_BUILD
+	static constexpr int DontWait = 0;
+#else
+	static constexpr int DontWait = MSG_DONTWAIT;
+#endif // _MSC_BUILD
+	// per-call zero copy flag (needs SO_ZEROCOPY on the socket). 0 where the platform has none
+#ifdef __linux__
+	static constexpr int ZeroCopy = MSG_ZEROCOPY;
+#else
+	static constexpr int ZeroCopy = 0;
+#endif // __linux__
+
+	// upper bound of buffers handed to a single vectored send
+	static constexpr size_t MaxVector = 64;
+
+	static bool WouldBlock(int err) {
+#ifdef _MSC_BUILD
+		return err == WSAEWOULDBLOCK;
+#else
+		return err == EAGAIN || err == EWOULDBLOCK;
+#endif
+	}
+
+	static bool Interrupted(int err) {
+#ifdef _MSC_BUILD
+		return err == WSAEINTR;
+#else
+		return err == EINTR;
+#endif
+	}
+
+	using deadline_t = std::chrono::steady_clock::time_point;
+
+	// timeout [ms] to an absolute deadline. a negative timeout never expires
+	static deadline_t Deadline(int timeout) {
+		return timeout < 0 ? deadline_t::max() : std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	}
+	// milliseconds left until deadline (-1 = infinite), rounded up so a wait never ends early
+	static int Remaining(deadline_t deadline) {
+		if (deadline == deadline_t::max()) {
+			return -1;
+		}
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		return static_cast<int>(std::clamp<decltype(left)>(left, 0, INT_MAX));
+	}
+
+	static bool SetOption(sock_t s, int level, int name, int value) {
+		if (setsockopt(s, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) != 0) {
+			dbg_print();
+			return false;
+		}
+		return true;
+	}
+	static std::optional<int> GetOption(sock_t s, int level, int name) {
+		int value = 0;
+		socklen_t len = sizeof(value);
+		if (getsockopt(s, level, name, reinterpret_cast<char*>(&value), &len) != 0) {
+			dbg_print();
+			return std::nullopt;
+		}
+		return value;
+	}
+	// SO_ERROR, which reading clears. a POLLERR with none pending comes from the error queue
+	// (e.g. zero copy completions) rather than from a failed connection
+	static int PendingError(sock_t s) {
+		return GetOption(s, SOL_SOCKET, SO_ERROR).value_or(-1);
+	}
+
+};
+
+
+/// <summary>
+/// Socket Options
+/// </summary>
+
+/// <summary>
+/// Typed socket option profile. unset fields are left alone, so profiles compose with | (the right side wins).
+/// apply one with SocketBase::Apply, or with basic_TCPServer::Configure, which also sets it on every accepted socket.
+/// options the platform lacks make Apply return false; the rest are still applied.
+/// </summary>
+struct SocketOptions {
+	// TCP_NODELAY: no Nagle delay for small writes
+	std::optional<bool> NoDelay;
+	// TCP_CORK (TCP_NOPUSH on BSD): hold partial segments; basic_TCPSocket pushes them out after each blocking send
+	// and whenever Flush drains the queue
+	std::optional<bool> Cork;
+	// TCP_QUICKACK (linux): acknowledge at once instead of delaying
+	std::optional<bool> QuickAck;
+	std::optional<bool> KeepAlive;
+	// SO_SNDBUF / SO_RCVBUF [bytes]
+	std::optional<int> SendBuffer;
+	std::optional<int> RecvBuffer;
+	// SO_BUSY_POLL [us] (linux): spin on the device queue before sleeping in a blocking receive.
+	// raising it above net.core.busy_read needs CAP_NET_ADMIN, so no preset sets it
+	std::optional<int> BusyPoll;
+	// TCP_NOTSENT_LOWAT [bytes]: unsent data above this keeps the socket from polling writable
+	std::optional<int> NotSentLowat;
+	// TCP_FASTOPEN (listener): length of the pending fast open queue
+	std::optional<int> FastOpen;
+	std::optional<bool> ReuseAddr;
+	std::optional<bool> ReusePort;
+
+	/// <summary>
+	/// Request / response traffic: no Nagle, immediate acks and a small unsent backlog.
+	/// </summary>
+	static SocketOptions LowLatency() {
+		SocketOptions ret;
+		ret.NoDelay = true;
+		ret.QuickAck = true;
+		ret.NotSentLowat = 16 * 1024;
+		return ret;
+	}
+	/// <summary>
+	/// Bulk streams: large buffers, and corked writes that go out as full segments on each Flush.
+	/// </summary>
+	static SocketOptions Throughput() {
+		SocketOptions ret;
+		ret.Cork = true;
+		ret.SendBuffer = 4 * 1024 * 1024;
+		ret.RecvBuffer = 4 * 1024 * 1024;
+		return ret;
+	}
+
+	SocketOptions& operator|=(const SocketOptions& other) {
+		auto overlay = [](auto& field, const auto& value) {
+			if (value) {
+				field = value;
+			}
+		};
+		overlay(NoDelay, other.NoDelay);
+		overlay(Cork, other.Cork);
+		overlay(QuickAck, other.QuickAck);
+		overlay(KeepAlive, other.KeepAlive);
+		overlay(SendBuffer, other.SendBuffer);
+		overlay(RecvBuffer, other.RecvBuffer);
+		overlay(BusyPoll, other.BusyPoll);
+		overlay(NotSentLowat, other.NotSentLowat);
+		overlay(FastOpen, other.FastOpen);
+		overlay(ReuseAddr, other.ReuseAddr);
+		overlay(ReusePort, other.ReusePort);
+		return *this;
+	}
+	friend SocketOptions operator|(SocketOptions lhs, const SocketOptions& rhs) {
+		return lhs |= rhs;
+	}
+
+	// the part set on a listener. accepted sockets inherit its buffer sizes, so those are set there only
+	SocketOptions ForListener() const {
+		SocketOptions ret;
+		ret.NoDelay = NoDelay;
+		ret.SendBuffer = SendBuffer;
+		ret.RecvBuffer = RecvBuffer;
+		ret.FastOpen = FastOpen;
+		ret.ReuseAddr = ReuseAddr;
+		ret.ReusePort = ReusePort;
+		return ret;
+	}
+	// the part set on every accepted socket
+	SocketOptions ForConnection() const {
+		SocketOptions ret;
+		ret.NoDelay = NoDelay;
+		ret.Cork = Cork;
+		ret.QuickAck = QuickAck;
+		ret.KeepAlive = KeepAlive;
+		ret.BusyPoll = BusyPoll;
+		ret.NotSentLowat = NotSentLowat;
+		return ret;
+	}
+
+	bool ApplyTo(SocketTraits::sock_t s) const {
+		bool ret = true;
+		auto set = [&](const auto& field, int level, int name) {
+			if (field) {
+				ret &= SocketTraits::SetOption(s, level, name, static_cast<int>(*field));
+			}
+		};
+		[[maybe_unused]] auto unsupported = [&](const auto& field) {
+			ret &= !field.has_value();
+		};
+		set(NoDelay, IPPROTO_TCP, TCP_NODELAY);
+#if defined(TCP_CORK)
+		set(Cork, IPPROTO_TCP, TCP_CORK);
+#elif defined(TCP_NOPUSH)
+		set(Cork, IPPROTO_TCP, TCP_NOPUSH);
+#else
+		unsupported(Cork);
+#endif
+#ifdef TCP_QUICKACK
+		set(QuickAck, IPPROTO_TCP, TCP_QUICKACK);
+#else
+		unsupported(QuickAck);
+#endif // TCP_QUICKACK
+		set(KeepAlive, SOL_SOCKET, SO_KEEPALIVE);
+		set(SendBuffer, SOL_SOCKET, SO_SNDBUF);
+		set(RecvBuffer, SOL_SOCKET, SO_RCVBUF);
+#ifdef SO_BUSY_POLL
+		set(BusyPoll, SOL_SOCKET, SO_BUSY_POLL);
+#else
+		unsupported(BusyPoll);
+#endif // SO_BUSY_POLL
+#ifdef TCP_NOTSENT_LOWAT
+		set(NotSentLowat, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+#else
+		unsupported(NotSentLowat);
+#endif // TCP_NOTSENT_LOWAT
+#ifdef TCP_FASTOPEN
+		set(FastOpen, IPPROTO_TCP, TCP_FASTOPEN);
+#else
+		unsupported(FastOpen);
+#endif // TCP_FASTOPEN
+		set(ReuseAddr, SOL_SOCKET, SO_REUSEADDR);
+#ifdef SO_REUSEPORT
+		set(ReusePort, SOL_SOCKET, SO_REUSEPORT);
+#else
+		unsupported(ReusePort);
+#endif // SO_REUSEPORT
+		return ret;
+	}
+};
+
+
+/// <summary>
+/// Socket Base
+/// </summary>
+
+template<class ipT, Protocol _protocol>
+class SocketBase {
+public:
+	using IPType = ipT;
+
+	using bytearray = SocketDetail::bytearray;
+
+	template<class T>
+	static constexpr bool memcpyable = SocketDetail::memcpyable<T>;
+
+	using poll_t = SocketTraits::poll_t;
+	using sock_t = SocketTraits::sock_t;
+
 	SocketBase() {
 #ifdef _MSC_BUILD
 		WinSock::GetInstance();
@@ -287,11 +741,7 @@ public:
 	void Close() {
 		if (!IsValid()) return;
 
-#ifdef _MSC_BUILD
-		closesocket(sock());
-#else
-		close(sock());
-#endif
+		SocketTraits::CloseSocket(sock());
 		Release();
 	}
 
@@ -303,6 +753,29 @@ public:
 		return sock() != InValidSocket();
 	}
 
+	sock_t Handle() const {
+		return sock();
+	}
+
+	void _NonBlocking() {
+		SocketTraits::NonBlocking(sock());
+	}
+
+	// sets every option the profile holds. false when one of them failed or does not exist here
+	bool Apply(const SocketOptions& options) {
+		return options.ApplyTo(sock());
+	}
+
+	/// <summary>
+	/// Blocks until the socket is readable (or hung up) or timeout [ms] passes. -1 waits forever.
+	/// </summary>
+	bool WaitReadable(int timeout) const {
+		return Wait(POLLIN, timeout) > 0;
+	}
+	bool WaitWritable(int timeout) const {
+		return Wait(POLLOUT, timeout) > 0;
+	}
+
 	friend bool operator==(const SocketBase& lhs, const SocketBase& rhs) {
 		return lhs.sock() == rhs.sock();
 	}
@@ -333,25 +806,86 @@ protected:
 		pfd.fd = -1;
 	}
 
+	// waits up to timeout [ms] (-1 = infinite); signals do not cut the wait short
 	static int Poll(poll_t* fds, unsigned int nfds, int timeout) {
+		SocketTraits::deadline_t deadline = SocketTraits::Deadline(timeout);
+		while (true) {
 #ifdef _MSC_BUILD
-		int ret = WSAPoll(fds, nfds, 0);
+			int ret = WSAPoll(fds, nfds, timeout);
 #else 
-		int ret = poll(fds, nfds, 0);
+			int ret = poll(fds, nfds, timeout);
 #endif // _MSC_BUILD
-		return ret;
+			if (ret >= 0 || !SocketTraits::Interrupted(_last_error())) {
+				return ret;
+			}
+			timeout = SocketTraits::Remaining(deadline);
+		}
+	}
+	int Wait(short events, int timeout) const {
+		poll_t p{};
+		p.fd = sock();
+		p.events = events;
+		return Poll(&p, 1, timeout);
 	}
 
 	SocketBase(sock_t s) {
 		pfd.fd = s;
 	}
 
-	static sock_t InValidSocket() {
+	// transport primitives. derived bases (e.g. URingSocketBase) hide these to swap the backend.
+	int SendSome(const void* src, int size, int flags = 0) {
+		return send(sock(), static_cast<const char*>(src), size, flags);
+	}
+	int RecvSome(void* dest, int size, int flags = 0) {
+		return recv(sock(), static_cast<char*>(dest), size, flags);
+	}
+	// nonblocking hands out the client already in non-blocking mode (one accept4 call on linux)
+	sock_t AcceptRaw(bool nonblocking = false) {
+#ifdef __linux__
+		return accept4(sock(), nullptr, nullptr, SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0));
+#else
+		sock_t ret = accept(sock(), nullptr, nullptr);
+		if (nonblocking && ret != InValidSocket()) {
+			SocketTraits::NonBlocking(ret);
+		}
+		return ret;
+#endif // __linux__
+	}
+	// gathers up to SocketTraits::MaxVector buffers into one send
+	int SendVector(const SocketDetail::byte_view* bufs, size_t count, int flags = 0) {
+		count = std::min(count, SocketTraits::MaxVector);
 #ifdef _MSC_BUILD
-		return INVALID_SOCKET;
+		std::array<WSABUF, SocketTraits::MaxVector> wsabufs;
+		for (size_t i = 0; i < count; ++i) {
+			wsabufs[i].buf = reinterpret_cast<CHAR*>(const_cast<SocketDetail::byte_t*>(bufs[i].data()));
+			wsabufs[i].len = static_cast<ULONG>(bufs[i].size());
+		}
+		DWORD sended = 0;
+		if (WSASend(sock(), wsabufs.data(), static_cast<DWORD>(count), &sended, static_cast<DWORD>(flags), nullptr, nullptr) == SOCKET_ERROR) {
+			return -1;
+		}
+		return static_cast<int>(sended);
 #else
-		return -1;
-#endif
+		std::array<struct iovec, SocketTraits::MaxVector> iov;
+		struct msghdr msg{};
+		MakeMessage(msg, iov.data(), bufs, count);
+		return static_cast<int>(sendmsg(sock(), &msg, flags));
+#endif // _MSC_BUILD
+	}
+
+#ifndef _MSC_BUILD
+	static void MakeMessage(struct msghdr& msg, struct iovec* iov, const SocketDetail::byte_view* bufs, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			iov[i].iov_base = const_cast<SocketDetail::byte_t*>(bufs[i].data());
+			iov[i].iov_len = bufs[i].size();
+		}
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+	}
+#endif // _MSC_BUILD
+
+	static sock_t InValidSocket() {
+		return SocketTraits::InValidSocket();
 	}
 
 	sock_t& sock() {
@@ -365,327 +899,5101 @@ protected:
 };
 
 /// <summary>
-/// TCP Protocol Socket
+/// Poll Set
 /// </summary>
 
-template<class ipT, class sockbase = SocketBase<ipT, Protocol::TCP>>
-class basic_TCPSocket : public sockbase {
-	template<class, class>
-	friend class basic_TCPServer;
-protected:
-
-	using sockbase::sockbase;
-
+/// <summary>
+/// Blocking wait on many sockets at once. the descriptor list is kept between waits, so a loop can
+/// Clear() and re-Add() every round without reallocating.
+/// </summary>
+class PollSet {
 public:
+	using sock_t = SocketTraits::sock_t;
+	using poll_t = SocketTraits::poll_t;
 
-	using bytearray = typename sockbase::bytearray;
-
-	basic_TCPSocket() : sockbase() {}
-	basic_TCPSocket(typename sockbase::IPType addr) : basic_TCPSocket() {
-		Connect(addr);
+	// returns the index used by Readable / Writable / Hangup
+	size_t Add(sock_t fd, bool writable = false) {
+		poll_t p{};
+		p.fd = fd;
+		p.events = POLLIN | (writable ? POLLOUT : 0);
+		m_fds.push_back(p);
+		return m_fds.size() - 1;
 	}
-
-	basic_TCPSocket(const basic_TCPSocket&) = delete;
-	basic_TCPSocket(basic_TCPSocket&& other) noexcept : CryptEngine(std::move(other.CryptEngine)), sockbase(std::move(other)) {}
-
-	basic_TCPSocket& operator=(const basic_TCPSocket&) = delete;
-	basic_TCPSocket& operator=(basic_TCPSocket&& other) noexcept {
-		CryptEngine = std::move(other.CryptEngine);
-		sockbase::operator=(std::move(other));
-		return *this;
+	template<class ipT, Protocol _protocol>
+	size_t Add(const SocketBase<ipT, _protocol>& s, bool writable = false) {
+		return Add(s.Handle(), writable);
+	}
+	void Clear() {
+		m_fds.clear();
+	}
+	size_t Size() const {
+		return m_fds.size();
 	}
 
-	bool Connect(typename sockbase::IPType hostaddr, int timeout = 0) {
-		if (connect(sockbase::sock(), hostaddr, sizeof(typename sockbase::IPType)) < 0) {
-			dbg_print();
-			return false;
+	/// <summary>
+	/// Blocks until any socket is ready or timeout [ms] passes (-1 = infinite).
+	/// returns the number of ready sockets, 0 on timeout, -1 on error.
+	/// </summary>
+	int Wait(int timeout = -1) {
+		if (m_fds.empty()) {
+			return 0;
 		}
-		return true;
-	}
-	int Available() const {
+		SocketTraits::deadline_t deadline = SocketTraits::Deadline(timeout);
+		while (true) {
 #ifdef _MSC_BUILD
-		u_long bytes = 0;
-		if (ioctlsocket(sockbase::sock(), FIONREAD, &bytes) == SOCKET_ERROR) {
-			dbg_print();
-			return -1;
+			int ret = WSAPoll(m_fds.data(), static_cast<ULONG>(m_fds.size()), timeout);
+#else
+			int ret = poll(m_fds.data(), static_cast<nfds_t>(m_fds.size()), timeout);
+#endif // _MSC_BUILD
+			if (ret >= 0) {
+				return ret;
+			}
+			if (!SocketTraits::Interrupted(_last_error())) {
+				dbg_print();
+				return -1;
+			}
+			timeout = SocketTraits::Remaining(deadline);
 		}
-		return static_cast<int>(bytes);
-#else 
-		int bytes = 0;
-		if (ioctl(sockbase::sock(), FIONREAD, &bytes) < 0) {
-			dbg_print();
+	}
+
+	bool Readable(size_t i) const {
+		return m_fds[i].revents & POLLIN;
+	}
+	bool Writable(size_t i) const {
+		return m_fds[i].revents & POLLOUT;
+	}
+	bool Hangup(size_t i) const {
+		return m_fds[i].revents & (POLLHUP | POLLERR);
+	}
+
+private:
+	std::vector<poll_t> m_fds;
+};
+
+/// <summary>
+/// Liveness Monitor
+/// </summary>
+
+/// <summary>
+/// Watches many connections for hang-ups with a single wait instead of one LostConnection() per socket.
+/// on linux only HUP / ERR / RDHUP wake it (edge-triggered epoll), so incoming data costs nothing here.
+/// other platforms poll every socket and peek the ones that turned readable.
+/// </summary>
+class LivenessMonitor {
+public:
+	using sock_t = SocketTraits::sock_t;
+	using poll_t = SocketTraits::poll_t;
+
+	LivenessMonitor() {
+#ifdef __linux__
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (m_epoll < 0) {
+			dbg_print();
+		}
+#endif // __linux__
+	}
+	~LivenessMonitor() {
+#ifdef __linux__
+		if (m_epoll >= 0) {
+			close(m_epoll);
+		}
+#endif // __linux__
+	}
+
+	LivenessMonitor(const LivenessMonitor&) = delete;
+	LivenessMonitor& operator=(const LivenessMonitor&) = delete;
+
+	bool Watch(sock_t fd) {
+#ifdef __linux__
+		struct epoll_event ev{};
+		ev.events = EPOLLRDHUP | EPOLLET;
+		ev.data.fd = fd;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST) {
+			dbg_print();
+			return false;
+		}
+#endif // __linux__
+		m_alive[fd] = true;
+		return true;
+	}
+	bool Unwatch(sock_t fd) {
+		if (m_alive.erase(fd) == 0) {
+			return false;
+		}
+#ifdef __linux__
+		// closing the descriptor already removed it from the epoll set
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+#endif // __linux__
+		return true;
+	}
+	template<class ipT, Protocol _protocol>
+	bool Watch(const SocketBase<ipT, _protocol>& s) {
+		return Watch(s.Handle());
+	}
+	template<class ipT, Protocol _protocol>
+	bool Unwatch(const SocketBase<ipT, _protocol>& s) {
+		return Unwatch(s.Handle());
+	}
+
+	// false for dead and for unknown sockets
+	bool IsAlive(sock_t fd) const {
+		auto it = m_alive.find(fd);
+		return it != m_alive.end() && it->second;
+	}
+	size_t Count() const {
+		return m_alive.size();
+	}
+
+	/// <summary>
+	/// Waits up to timeout [ms] (0 = just check, -1 = infinite) and returns the peers that died since the last call.
+	/// each socket is reported once; it stays watched (and not alive) until Unwatch().
+	/// </summary>
+	const std::vector<sock_t>& Poll(int timeout = 0) {
+		m_dead.clear();
+#ifdef __linux__
+		int ret = epoll_wait(m_epoll, m_events.data(), static_cast<int>(m_events.size()), timeout);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				dbg_print();
+			}
+			return m_dead;
+		}
+		for (int i = 0; i < ret; ++i) {
+			const auto& ev = m_events[i];
+			// a bare EPOLLERR with SO_ERROR clear is a zero copy completion, reaped by the socket's owner
+			if ((ev.events & (EPOLLHUP | EPOLLRDHUP)) || SocketTraits::PendingError(ev.data.fd) != 0) {
+				MarkDead(ev.data.fd);
+			}
+		}
+#else
+		m_pollfds.clear();
+		for (auto&& [fd, alive] : m_alive) {
+			if (alive) {
+				poll_t p{};
+				p.fd = fd;
+				p.events = POLLIN;
+				m_pollfds.push_back(p);
+			}
+		}
+		if (m_pollfds.empty()) {
+			return m_dead;
+		}
+#ifdef _MSC_BUILD
+		int ret = WSAPoll(m_pollfds.data(), static_cast<ULONG>(m_pollfds.size()), timeout);
+#else
+		int ret = poll(m_pollfds.data(), static_cast<nfds_t>(m_pollfds.size()), timeout);
+#endif // _MSC_BUILD
+		if (ret <= 0) {
+			return m_dead;
+		}
+		for (auto&& p : m_pollfds) {
+			if ((p.revents & POLLHUP) || ((p.revents & POLLERR) && SocketTraits::PendingError(p.fd) != 0)) {
+				MarkDead(p.fd);
+			}
+			else if (p.revents & POLLIN) {
+				// readable may be data or the peer's FIN; only a peek tells them apart here
+				char buf;
+				int r = recv(p.fd, &buf, 1, MSG_PEEK);
+				if (r == 0 || (r < 0 && !SocketTraits::WouldBlock(_last_error()) && !SocketTraits::Interrupted(_last_error()))) {
+					MarkDead(p.fd);
+				}
+			}
+		}
+#endif // __linux__
+		return m_dead;
+	}
+
+private:
+
+	void MarkDead(sock_t fd) {
+		auto it = m_alive.find(fd);
+		if (it != m_alive.end() && it->second) {
+			it->second = false;
+			m_dead.push_back(fd);
+		}
+	}
+
+#ifdef __linux__
+	int m_epoll = -1;
+	std::array<struct epoll_event, 256> m_events{};
+#else
+	std::vector<poll_t> m_pollfds;
+#endif // __linux__
+	std::unordered_map<sock_t, bool> m_alive;
+	std::vector<sock_t> m_dead;
+};
+
+/// <summary>
+/// Coroutine Task
+/// </summary>
+
+namespace SocketDetail {
+
+	template<class T>
+	struct task_result {
+		std::optional<T> value;
+
+		void return_value(T v) {
+			value = std::move(v);
+		}
+		T Take() {
+			return std::move(*value);
+		}
+	};
+	template<>
+	struct task_result<void> {
+		void return_void() {}
+		void Take() {}
+	};
+
+}
+
+/// <summary>
+/// Lazily started coroutine. co_await it from another Task, or hand it to EventLoop::Spawn / RunUntilComplete.
+/// </summary>
+template<class T = void>
+class Task {
+public:
+
+	struct promise_type;
+	using handle_t = std::coroutine_handle<promise_type>;
+
+	struct FinalAwaiter {
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle_t h) noexcept {
+			promise_type& p = h.promise();
+			if (p.continuation) {
+				return p.continuation;
+			}
+			if (p.detached) {
+				h.destroy();
+			}
+			return std::noop_coroutine();
+		}
+		void await_resume() const noexcept {}
+	};
+
+	struct promise_type : SocketDetail::task_result<T> {
+		std::coroutine_handle<> continuation = nullptr;
+		std::exception_ptr exception = nullptr;
+		bool detached = false;
+
+		Task get_return_object() {
+			return Task(handle_t::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		FinalAwaiter final_suspend() const noexcept { return {}; }
+		void unhandled_exception() {
+			exception = std::current_exception();
+		}
+	};
+
+	struct Awaiter {
+		handle_t handle;
+
+		bool await_ready() const noexcept {
+			return !handle || handle.done();
+		}
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept {
+			handle.promise().continuation = cont;
+			return handle;
+		}
+		T await_resume() {
+			if (handle.promise().exception) {
+				std::rethrow_exception(handle.promise().exception);
+			}
+			return handle.promise().Take();
+		}
+	};
+
+	Task() {}
+	Task(const Task&) = delete;
+	Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+	~Task() {
+		if (m_handle) {
+			m_handle.destroy();
+		}
+	}
+
+	Task& operator=(const Task&) = delete;
+	Task& operator=(Task&& other) noexcept {
+		if (this != &other) {
+			if (m_handle) {
+				m_handle.destroy();
+			}
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+
+	Awaiter operator co_await() && noexcept {
+		return Awaiter{m_handle};
+	}
+
+	bool IsDone() const {
+		return !m_handle || m_handle.done();
+	}
+	/// <summary>
+	/// Runs the task until its first suspension point.
+	/// </summary>
+	void Resume() {
+		if (!IsDone()) {
+			m_handle.resume();
+		}
+	}
+	/// <summary>
+	/// Starts the task and lets it free itself when it finishes. exceptions of a detached task are discarded.
+	/// </summary>
+	void Detach() {
+		if (!m_handle) {
+			return;
+		}
+		handle_t h = std::exchange(m_handle, nullptr);
+		if (h.done()) {
+			h.destroy();
+			return;
+		}
+		h.promise().detached = true;
+		h.resume();
+	}
+	T Result() {
+		if (!m_handle || !m_handle.done()) {
+			throw std::runtime_error("task is not completed");
+		}
+		return Awaiter{m_handle}.await_resume();
+	}
+
+private:
+
+	explicit Task(handle_t h) : m_handle(h) {}
+
+	handle_t m_handle = nullptr;
+};
+
+
+/// <summary>
+/// Event Loop (epoll reactor)
+/// </summary>
+
+class EventLoop {
+public:
+	using sock_t = SocketTraits::sock_t;
+	using poll_t = SocketTraits::poll_t;
+
+	using callback_t = std::function<void()>;
+
+	// Registration is edge-triggered on linux (epoll), so Readable / Writable must drain
+	// the socket until it would block. Other platforms fall back to a level-triggered poll.
+	struct Handler {
+		callback_t Readable;
+		callback_t Writable;
+		callback_t Hangup;
+		// an error without a hang-up: returns whether the connection failed, which then runs Hangup.
+		// unset, SO_ERROR decides (see basic_TCPSocket::PollError for sockets sending zero copy)
+		std::function<bool()> Error;
+	};
+
+	EventLoop() {
+#ifdef _MSC_BUILD
+		WinSock::GetInstance();
+#endif // _MSC_BUILD
+#ifdef __linux__
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (m_epoll < 0) {
+			dbg_print();
+			return;
+		}
+		m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_wake < 0) {
+			dbg_print();
+			return;
+		}
+		struct epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = m_wake;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev) < 0) {
+			dbg_print();
+		}
+#else
+		// a loopback datagram socket connected to itself is the portable wakeup channel
+		m_wake = socket(AF_INET, SOCK_DGRAM, 0);
+		if (m_wake == SocketTraits::InValidSocket()) {
+			dbg_print();
+			return;
+		}
+		struct sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t addrlen = sizeof(addr);
+		if (bind(m_wake, reinterpret_cast<sockaddr*>(&addr), addrlen) != 0 ||
+			getsockname(m_wake, reinterpret_cast<sockaddr*>(&addr), &addrlen) != 0 ||
+			connect(m_wake, reinterpret_cast<sockaddr*>(&addr), addrlen) != 0) {
+			dbg_print();
+		}
+		SocketTraits::NonBlocking(m_wake);
+#endif // __linux__
+	}
+	~EventLoop() {
+#ifdef __linux__
+		if (m_epoll >= 0) {
+			close(m_epoll);
+		}
+#endif // __linux__
+		if (m_wake != SocketTraits::InValidSocket()) {
+			SocketTraits::CloseSocket(m_wake);
+		}
+	}
+
+	EventLoop(const EventLoop&) = delete;
+	EventLoop(EventLoop&&) = delete;
+	EventLoop& operator=(const EventLoop&) = delete;
+	EventLoop& operator=(EventLoop&&) = delete;
+
+	bool Add(sock_t fd, Handler handler, bool writable = false) {
+#ifdef __linux__
+		struct epoll_event ev{};
+		ev.events = Events(writable);
+		ev.data.fd = fd;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			if (errno != EEXIST || epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) < 0) {
+				dbg_print();
+				return false;
+			}
+		}
+#endif // __linux__
+		m_handlers[fd] = Entry{std::make_shared<Handler>(std::move(handler)), writable};
+		m_waiters.erase(fd);
+		return true;
+	}
+	bool Modify(sock_t fd, bool writable) {
+		auto it = m_handlers.find(fd);
+		if (it == m_handlers.end()) {
+			return false;
+		}
+#ifdef __linux__
+		struct epoll_event ev{};
+		ev.events = Events(writable);
+		ev.data.fd = fd;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) < 0) {
+			dbg_print();
+			return false;
+		}
+#endif // __linux__
+		it->second.writable = writable;
+		return true;
+	}
+	bool Remove(sock_t fd) {
+		auto it = m_handlers.find(fd);
+		if (it == m_handlers.end()) {
+			return false;
+		}
+#ifdef __linux__
+		// the descriptor may already be closed, which removes it from the epoll set implicitly
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+#endif // __linux__
+		m_handlers.erase(it);
+		m_waiters.erase(fd);
+		return true;
+	}
+
+	template<class ipT, Protocol _protocol>
+	bool Add(const SocketBase<ipT, _protocol>& s, Handler handler, bool writable = false) {
+		return Add(s.Handle(), std::move(handler), writable);
+	}
+	template<class ipT, Protocol _protocol>
+	bool Modify(const SocketBase<ipT, _protocol>& s, bool writable) {
+		return Modify(s.Handle(), writable);
+	}
+	template<class ipT, Protocol _protocol>
+	bool Remove(const SocketBase<ipT, _protocol>& s) {
+		return Remove(s.Handle());
+	}
+
+	/// <summary>
+	/// Suspends the awaiting coroutine until fd is readable (or writable) or hung up. a reader and a writer
+	/// may wait on the same descriptor at once. the registration outlives the wait, so awaiting again costs one
+	/// epoll_ctl; Remove(fd) drops it. the descriptor must not be registered with a handler of its own.
+	/// co_await yields false, without suspending, when the wait could not be registered.
+	/// </summary>
+	struct ReadyAwaiter {
+		EventLoop& loop;
+		sock_t fd;
+		bool writable;
+		bool registered = false;
+
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> h) {
+			registered = loop.Await(fd, writable, h);
+			return registered;
+		}
+		bool await_resume() const noexcept {
+			return registered;
+		}
+	};
+
+	ReadyAwaiter Readable(sock_t fd) {
+		return ReadyAwaiter{*this, fd, false};
+	}
+	ReadyAwaiter Writable(sock_t fd) {
+		return ReadyAwaiter{*this, fd, true};
+	}
+
+	// Timers. callbacks run on the loop thread between event dispatches.
+
+	TimerWheel& Timers() {
+		return m_timers;
+	}
+	TimerWheel::timer_t After(TimerWheel::duration delay, TimerWheel::callback_t cb) {
+		return m_timers.Arm(delay, std::move(cb));
+	}
+	bool Cancel(TimerWheel::timer_t timer) {
+		return m_timers.Cancel(timer);
+	}
+
+	/// <summary>
+	/// Suspends the awaiting coroutine for delay.
+	/// </summary>
+	struct SleepAwaiter {
+		EventLoop& loop;
+		TimerWheel::duration delay;
+
+		bool await_ready() const noexcept { return delay.count() <= 0; }
+		void await_suspend(std::coroutine_handle<> h) {
+			loop.After(delay, [h] { h.resume(); });
+		}
+		void await_resume() const noexcept {}
+	};
+
+	SleepAwaiter Sleep(TimerWheel::duration delay) {
+		return SleepAwaiter{*this, delay};
+	}
+
+	/// <summary>
+	/// Starts a task on this thread; it resumes from this loop whenever it awaits readiness.
+	/// </summary>
+	template<class T>
+	void Spawn(Task<T> task) {
+		task.Detach();
+	}
+	/// <summary>
+	/// Dispatches events until the task completes and returns its result.
+	/// </summary>
+	template<class T>
+	T RunUntilComplete(Task<T> task) {
+		task.Resume();
+		while (!task.IsDone()) {
+			if (RunOnce(-1) < 0) {
+				break;
+			}
+		}
+		return task.Result();
+	}
+
+	/// <summary>
+	/// Default loop of the calling thread, shared by the Async* socket coroutines.
+	/// </summary>
+	static EventLoop& Current() {
+		thread_local EventLoop loop;
+		return loop;
+	}
+
+	bool Contains(sock_t fd) const {
+		return m_handlers.contains(fd);
+	}
+	size_t Count() const {
+		return m_handlers.size();
+	}
+
+	/// <summary>
+	/// Waits up to timeout [ms] (-1 = infinite) and dispatches the ready callbacks, then the due timers.
+	/// the wait is cut short when a timer comes due first. returns the number of ready descriptors, or -1 on error.
+	/// </summary>
+	int RunOnce(int timeout = -1) {
+		int next = m_timers.NextTimeout();
+		if (next >= 0 && (timeout < 0 || next < timeout)) {
+			timeout = next;
+		}
+		int ret = Wait(timeout);
+		if (ret >= 0) {
+			RunPosted();
+			m_timers.Advance();
+		}
+		return ret;
+	}
+	/// <summary>
+	/// Dispatches events until Stop() is called.
+	/// </summary>
+	void Run() {
+		while (!m_stop.load(std::memory_order_acquire)) {
+			if (RunOnce(-1) < 0) {
+				break;
+			}
+		}
+		m_stop.store(false, std::memory_order_release);
+	}
+	/// <summary>
+	/// Runs f on the loop thread during its next RunOnce. may be called from any thread.
+	/// </summary>
+	void Post(callback_t f) {
+		{
+			std::lock_guard<std::mutex> lock(m_postmutex);
+			m_posted.push_back(std::move(f));
+		}
+		Wakeup();
+	}
+	/// <summary>
+	/// Stops Run(). may be called from any thread.
+	/// </summary>
+	void Stop() {
+		m_stop.store(true, std::memory_order_release);
+		Wakeup();
+	}
+	void Wakeup() {
+#ifdef __linux__
+		uint64_t one = 1;
+		if (write(m_wake, &one, sizeof(one)) < 0) {
+			dbg_print();
+		}
+#else
+		char one = 1;
+		send(m_wake, &one, 1, 0);
+#endif // __linux__
+	}
+
+private:
+
+	struct Entry {
+		std::shared_ptr<Handler> handler;
+		bool writable = false;
+		// false only for an awaited descriptor without a reader, which the level-triggered poll must then skip
+		bool readable = true;
+	};
+	// coroutines suspended on a descriptor through ReadyAwaiter, sharing the descriptor's one registration
+	struct Waiters {
+		std::shared_ptr<Handler> handler;
+		std::coroutine_handle<> read;
+		std::coroutine_handle<> write;
+	};
+
+	// false when fd already has a waiter of that kind or a handler of its own, or epoll refused it
+	bool Await(sock_t fd, bool writable, std::coroutine_handle<> h) {
+		auto it = m_handlers.find(fd);
+		Waiters& w = m_waiters[fd];
+		std::coroutine_handle<>& slot = writable ? w.write : w.read;
+		if (slot || (it != m_handlers.end() && it->second.handler != w.handler)) {
+			if (!w.handler) {
+				m_waiters.erase(fd);
+			}
+			return false;
+		}
+		if (!w.handler) {
+			w.handler = std::make_shared<Handler>();
+			w.handler->Readable = [this, fd] { Wake(fd, false); };
+			w.handler->Writable = [this, fd] { Wake(fd, true); };
+			w.handler->Hangup = [this, fd] {
+				Wake(fd, false);
+				Wake(fd, true);
+			};
+		}
+		bool interest = writable || w.write;
+#ifdef __linux__
+		// a MOD per wait, not only when the interest changes: it fails with ENOENT for a descriptor that is new,
+		// or that was closed and its number reused since the last wait, and that one is added instead
+		struct epoll_event ev{};
+		ev.events = Events(interest);
+		ev.data.fd = fd;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) < 0 && (errno != ENOENT || epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+			dbg_print();
+			if (!w.read && !w.write) {
+				m_waiters.erase(fd);
+			}
+			return false;
+		}
+#endif // __linux__
+		slot = h;
+		m_handlers[fd] = Entry{w.handler, interest, w.read != nullptr};
+		return true;
+	}
+	void Wake(sock_t fd, bool writable) {
+		auto it = m_waiters.find(fd);
+		if (it == m_waiters.end()) {
+			return;
+		}
+		Waiters& w = it->second;
+		std::coroutine_handle<> h = std::exchange(writable ? w.write : w.read, nullptr);
+		if (!h) {
+			return;
+		}
+		// epoll keeps the interest until the next wait; the poll fallback reads it from here
+		auto entry = m_handlers.find(fd);
+		if (entry != m_handlers.end() && entry->second.handler == w.handler) {
+			entry->second.writable = w.write != nullptr;
+			entry->second.readable = w.read != nullptr;
+		}
+		h.resume();
+	}
+
+#ifdef __linux__
+	static uint32_t Events(bool writable) {
+		return EPOLLIN | EPOLLRDHUP | EPOLLET | (writable ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+	}
+#endif // __linux__
+
+	void DrainWakeup() {
+#ifdef __linux__
+		uint64_t count = 0;
+		while (read(m_wake, &count, sizeof(count)) > 0) {}
+#else
+		char buf[64];
+		while (recv(m_wake, buf, sizeof(buf), 0) > 0) {}
+#endif // __linux__
+	}
+
+	// one wait on the descriptors and dispatch of whatever is ready
+	int Wait(int timeout) {
+#ifdef __linux__
+		int ret = epoll_wait(m_epoll, m_events.data(), static_cast<int>(m_events.size()), timeout);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				return 0;
+			}
+			dbg_print();
+			return -1;
+		}
+		for (int i = 0; i < ret; ++i) {
+			const auto& ev = m_events[i];
+			if (ev.data.fd == m_wake) {
+				DrainWakeup();
+				continue;
+			}
+			Dispatch(ev.data.fd,
+				ev.events & EPOLLIN,
+				ev.events & EPOLLOUT,
+				ev.events & (EPOLLHUP | EPOLLRDHUP),
+				ev.events & EPOLLERR);
+		}
+		return ret;
+#else
+		m_pollfds.clear();
+		m_pollfds.push_back(poll_t{m_wake, POLLIN, 0});
+		for (auto&& [fd, entry] : m_handlers) {
+			if (entry.readable || entry.writable) {
+				m_pollfds.push_back(poll_t{fd, static_cast<short>((entry.readable ? POLLIN : 0) | (entry.writable ? POLLOUT : 0)), 0});
+			}
+		}
+#ifdef _MSC_BUILD
+		int ret = WSAPoll(m_pollfds.data(), static_cast<ULONG>(m_pollfds.size()), timeout);
+#else
+		int ret = poll(m_pollfds.data(), static_cast<nfds_t>(m_pollfds.size()), timeout);
+#endif // _MSC_BUILD
+		if (ret < 0) {
+			dbg_print();
+			return -1;
+		}
+		if (m_pollfds[0].revents & POLLIN) {
+			DrainWakeup();
+		}
+		for (size_t i = 1; i < m_pollfds.size(); ++i) {
+			const auto& p = m_pollfds[i];
+			if (p.revents == 0) {
+				continue;
+			}
+			Dispatch(p.fd,
+				p.revents & POLLIN,
+				p.revents & POLLOUT,
+				p.revents & POLLHUP,
+				p.revents & POLLERR);
+		}
+		return ret;
+#endif // __linux__
+	}
+
+	void RunPosted() {
+		std::vector<callback_t> posted;
+		{
+			std::lock_guard<std::mutex> lock(m_postmutex);
+			posted.swap(m_posted);
+		}
+		for (auto&& f : posted) {
+			f();
+		}
+	}
+
+	bool Registered(sock_t fd, const std::shared_ptr<Handler>& handler) const {
+		auto it = m_handlers.find(fd);
+		return it != m_handlers.end() && it->second.handler == handler;
+	}
+
+	void Dispatch(sock_t fd, bool readable, bool writable, bool hangup, bool error) {
+		auto it = m_handlers.find(fd);
+		if (it == m_handlers.end()) {
+			return;
+		}
+		// callbacks may Remove() or re-Add() the descriptor, so keep the handler alive and re-check
+		std::shared_ptr<Handler> handler = it->second.handler;
+		if (readable && handler->Readable) {
+			handler->Readable();
+		}
+		if (writable && handler->Writable && Registered(fd, handler)) {
+			handler->Writable();
+		}
+		if (error && !hangup && Registered(fd, handler)) {
+			hangup = handler->Error ? handler->Error() : SocketTraits::PendingError(fd) != 0;
+		}
+		if (hangup && handler->Hangup && Registered(fd, handler)) {
+			handler->Hangup();
+		}
+	}
+
+#ifdef __linux__
+	int m_epoll = -1;
+	std::array<struct epoll_event, 256> m_events{};
+#else
+	std::vector<poll_t> m_pollfds;
+#endif // __linux__
+	sock_t m_wake = SocketTraits::InValidSocket();
+	std::atomic<bool> m_stop = false;
+	std::unordered_map<sock_t, Entry> m_handlers;
+	std::unordered_map<sock_t, Waiters> m_waiters;
+	TimerWheel m_timers;
+	std::mutex m_postmutex;
+	std::vector<callback_t> m_posted;
+};
+
+/// <summary>
+/// Resolver
+/// </summary>
+
+/// <summary>
+/// Caches getaddrinfo results per host name. Resolve blocks only on a miss; ResolveAsync runs
+/// misses on worker threads and delivers the answer on the caller's EventLoop, coalescing concurrent
+/// lookups of the same name into one query. failed lookups are cached for NegativeTTL.
+/// getaddrinfo reports no record TTL, so entries live for Options::TTL.
+/// </summary>
+template<class ipT>
+class basic_Resolver {
+public:
+
+	using IPType = ipT;
+	using clock_t = std::chrono::steady_clock;
+	using result_t = std::optional<IPType>;
+	using callback_t = std::function<void(result_t)>;
+
+	struct Options {
+		std::chrono::milliseconds TTL = std::chrono::seconds(60);
+		std::chrono::milliseconds NegativeTTL = std::chrono::seconds(5);
+		size_t MaxEntries = 1024;
+		// threads started on demand for ResolveAsync
+		size_t Workers = 2;
+	};
+
+	basic_Resolver() : basic_Resolver(Options{}) {}
+	explicit basic_Resolver(Options options) : m_options(options) {}
+	~basic_Resolver() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		for (auto&& worker : m_workers) {
+			worker.join();
+		}
+	}
+
+	basic_Resolver(const basic_Resolver&) = delete;
+	basic_Resolver& operator=(const basic_Resolver&) = delete;
+
+	/// <summary>
+	/// Process-wide resolver used by IPAddressBase::SolveHostName.
+	/// </summary>
+	static basic_Resolver& Default() {
+		static basic_Resolver instance;
+		return instance;
+	}
+
+	result_t Resolve(const std::string& host, Protocol protocol = Protocol::TCP) {
+		return First(ResolveAll(host, protocol));
+	}
+	std::vector<IPType> ResolveAll(const std::string& host, Protocol protocol = Protocol::TCP) {
+		if (auto numeric = IPType::FromNumeric(host)) {
+			return {*numeric};
+		}
+		std::string key = Key(host, protocol);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (auto hit = Find(key)) {
+				return *hit;
+			}
+		}
+		std::vector<IPType> ret = IPType::Lookup(host, protocol);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Store(key, ret);
+		return ret;
+	}
+
+	/// <summary>
+	/// Calls f with the result on loop's thread; never blocks. loop must outlive the lookup.
+	/// </summary>
+	void ResolveAsync(const std::string& host, EventLoop& loop, callback_t f, Protocol protocol = Protocol::TCP) {
+		if (auto numeric = IPType::FromNumeric(host)) {
+			loop.Post([f = std::move(f), numeric]() { f(numeric); });
+			return;
+		}
+		std::string key = Key(host, protocol);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (auto hit = Find(key)) {
+			loop.Post([f = std::move(f), ret = First(*hit)]() { f(ret); });
+			return;
+		}
+		auto& waiters = m_pending[key];
+		waiters.push_back(Waiter{&loop, std::move(f)});
+		if (waiters.size() > 1) {
+			return;
+		}
+		m_jobs.push_back(Job{host, protocol});
+		if (m_idle == 0 && m_workers.size() < std::max<size_t>(m_options.Workers, 1)) {
+			m_workers.emplace_back([this]() { Work(); });
+		}
+		m_cv.notify_one();
+	}
+
+	struct ResolveAwaiter {
+		basic_Resolver& resolver;
+		std::string host;
+		EventLoop& loop;
+		Protocol protocol;
+		result_t result{};
+
+		bool await_ready() {
+			if (auto numeric = IPType::FromNumeric(host)) {
+				result = numeric;
+				return true;
+			}
+			std::lock_guard<std::mutex> lock(resolver.m_mutex);
+			if (auto hit = resolver.Find(Key(host, protocol))) {
+				result = First(*hit);
+				return true;
+			}
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> h) {
+			resolver.ResolveAsync(host, loop, [this, h](result_t ret) {
+				result = std::move(ret);
+				h.resume();
+			}, protocol);
+		}
+		result_t await_resume() {
+			return std::move(result);
+		}
+	};
+
+	Task<result_t> AsyncResolve(std::string host, EventLoop& loop = EventLoop::Current(), Protocol protocol = Protocol::TCP) {
+		ResolveAwaiter awaiter{*this, std::move(host), loop, protocol};
+		co_return co_await awaiter;
+	}
+
+	void Clear() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cache.clear();
+	}
+	size_t Size() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_cache.size();
+	}
+
+private:
+
+	struct Entry {
+		std::vector<IPType> addresses;
+		clock_t::time_point expire;
+	};
+	struct Waiter {
+		EventLoop* loop;
+		callback_t callback;
+	};
+	struct Job {
+		std::string host;
+		Protocol protocol;
+	};
+
+	static std::string Key(const std::string& host, Protocol protocol) {
+		return std::to_string(static_cast<int>(protocol)) + ':' + host;
+	}
+	static result_t First(const std::vector<IPType>& addresses) {
+		if (addresses.empty()) {
+			return std::nullopt;
+		}
+		return addresses.front();
+	}
+
+	// callers hold m_mutex
+	const std::vector<IPType>* Find(const std::string& key) {
+		auto it = m_cache.find(key);
+		if (it == m_cache.end()) {
+			return nullptr;
+		}
+		if (it->second.expire <= clock_t::now()) {
+			m_cache.erase(it);
+			return nullptr;
+		}
+		return &it->second.addresses;
+	}
+	void Store(const std::string& key, const std::vector<IPType>& addresses) {
+		auto now = clock_t::now();
+		if (m_cache.size() >= m_options.MaxEntries && m_cache.find(key) == m_cache.end()) {
+			std::erase_if(m_cache, [now](const auto& entry) { return entry.second.expire <= now; });
+			if (m_cache.size() >= m_options.MaxEntries && !m_cache.empty()) {
+				m_cache.erase(m_cache.begin());
+			}
+		}
+		if (m_options.MaxEntries == 0) {
+			return;
+		}
+		m_cache[key] = Entry{addresses, now + (addresses.empty() ? m_options.NegativeTTL : m_options.TTL)};
+	}
+
+	void Work() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			++m_idle;
+			m_cv.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			--m_idle;
+			if (m_stop) {
+				return;
+			}
+			Job job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+
+			lock.unlock();
+			std::vector<IPType> addresses = IPType::Lookup(job.host, job.protocol);
+			lock.lock();
+
+			std::string key = Key(job.host, job.protocol);
+			Store(key, addresses);
+			auto it = m_pending.find(key);
+			if (it == m_pending.end()) {
+				continue;
+			}
+			std::vector<Waiter> waiters = std::move(it->second);
+			m_pending.erase(it);
+			result_t ret = First(addresses);
+			for (auto&& waiter : waiters) {
+				waiter.loop->Post([f = std::move(waiter.callback), ret]() { f(ret); });
+			}
+		}
+	}
+
+	Options m_options;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::unordered_map<std::string, Entry> m_cache;
+	std::unordered_map<std::string, std::vector<Waiter>> m_pending;
+	std::deque<Job> m_jobs;
+	std::vector<std::thread> m_workers;
+	size_t m_idle = 0;
+	bool m_stop = false;
+};
+
+#ifdef SOCKET_H_IO_URING
+
+/// <summary>
+/// io_uring submission / completion rings
+/// </summary>
+
+class IOUring {
+public:
+	using completion_t = std::function<void(int)>;
+
+	explicit IOUring(unsigned entries = 256) {
+		struct io_uring_params params{};
+		m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+		if (m_fd < 0) {
+			dbg_print();
+			return;
+		}
+		m_sqentries = params.sq_entries;
+
+		m_sqsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cqsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (single) {
+			m_sqsize = m_cqsize = std::max(m_sqsize, m_cqsize);
+		}
+
+		m_sqring = Map(m_sqsize, IORING_OFF_SQ_RING);
+		m_cqring = single ? m_sqring : Map(m_cqsize, IORING_OFF_CQ_RING);
+		m_sqes = static_cast<struct io_uring_sqe*>(Map(params.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES));
+		if (m_sqring == nullptr || m_cqring == nullptr || m_sqes == nullptr) {
+			Destroy();
+			return;
+		}
+
+		char* sq = static_cast<char*>(m_sqring);
+		m_sqhead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		m_sqtail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		m_sqmask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		m_sqarray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+		char* cq = static_cast<char*>(m_cqring);
+		m_cqhead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		m_cqtail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		m_cqmask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		m_localtail = *m_sqtail;
+		Probe();
+	}
+	~IOUring() {
+		Destroy();
+	}
+
+	IOUring(const IOUring&) = delete;
+	IOUring& operator=(const IOUring&) = delete;
+
+	bool IsValid() const {
+		return m_fd >= 0;
+	}
+	size_t InFlight() const {
+		return m_inflight;
+	}
+	// whether the running kernel implements opcode (IORING_REGISTER_PROBE, asked once per ring)
+	bool Supports(uint8_t opcode) const {
+		return m_supported[opcode];
+	}
+
+	/// <summary>
+	/// Runtime switch for the io_uring backend. when disabled, URingSocketBase uses the poll path.
+	/// </summary>
+	static bool IsEnabled() {
+		return EnabledFlag().load(std::memory_order_relaxed);
+	}
+	static void Enable(bool flag) {
+		EnabledFlag().store(flag, std::memory_order_relaxed);
+	}
+	/// <summary>
+	/// Ring owned by the calling thread, or nullptr when io_uring is disabled / unavailable.
+	/// </summary>
+	static IOUring* ThreadLocal() {
+		if (!IsEnabled()) {
+			return nullptr;
+		}
+		thread_local IOUring ring;
+		return ring.IsValid() ? &ring : nullptr;
+	}
+
+	bool RegisterBuffers(std::span<const struct iovec> buffers) {
+		return Register(IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size()));
+	}
+	bool UnregisterBuffers() {
+		return Register(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+	}
+	bool RegisterFiles(std::span<const int> fds) {
+		return Register(IORING_REGISTER_FILES, fds.data(), static_cast<unsigned>(fds.size()));
+	}
+	bool UpdateFile(unsigned index, int fd) {
+		struct io_uring_files_update update{};
+		update.offset = index;
+		update.fds = reinterpret_cast<uint64_t>(&fd);
+		return Register(IORING_REGISTER_FILES_UPDATE, &update, 1);
+	}
+	bool UnregisterFiles() {
+		return Register(IORING_UNREGISTER_FILES, nullptr, 0);
+	}
+
+	// Prepare* only queue an SQE; nothing reaches the kernel until Submit().
+	// `fixed` means fd is an index into RegisterFiles(), and `bufindex` an index into RegisterBuffers().
+
+	bool PrepareSend(int fd, const void* src, unsigned len, completion_t cb, int flags = 0, bool fixed = false) {
+		struct io_uring_sqe* sqe = Prepare(IORING_OP_SEND, fd, src, len, std::move(cb), fixed);
+		if (sqe == nullptr) {
+			return false;
+		}
+		sqe->msg_flags = static_cast<uint32_t>(flags);
+		return true;
+	}
+	bool PrepareSendMsg(int fd, const struct msghdr* msg, completion_t cb, int flags = 0, bool fixed = false) {
+		struct io_uring_sqe* sqe = Prepare(IORING_OP_SENDMSG, fd, msg, 1, std::move(cb), fixed);
+		if (sqe == nullptr) {
+			return false;
+		}
+		sqe->msg_flags = static_cast<uint32_t>(flags);
+		return true;
+	}
+	bool PrepareRecv(int fd, void* dest, unsigned len, completion_t cb, int flags = 0, bool fixed = false) {
+		struct io_uring_sqe* sqe = Prepare(IORING_OP_RECV, fd, dest, len, std::move(cb), fixed);
+		if (sqe == nullptr) {
+			return false;
+		}
+		sqe->msg_flags = static_cast<uint32_t>(flags);
+		return true;
+	}
+	bool PrepareAccept(int fd, completion_t cb, int flags = 0, bool fixed = false) {
+		struct io_uring_sqe* sqe = Prepare(IORING_OP_ACCEPT, fd, nullptr, 0, std::move(cb), fixed);
+		if (sqe == nullptr) {
+			return false;
+		}
+		sqe->accept_flags = static_cast<uint32_t>(SOCK_CLOEXEC | flags);
+		return true;
+	}
+	bool PrepareWriteFixed(int fd, const void* src, unsigned len, uint16_t bufindex, completion_t cb, bool fixed = false) {
+		struct io_uring_sqe* sqe = Prepare(IORING_OP_WRITE_FIXED, fd, src, len, std::move(cb), fixed);
+		if (sqe == nullptr) {
+			return false;
+		}
+		sqe->buf_index = bufindex;
+		return true;
+	}
+	bool PrepareReadFixed(int fd, void* dest, unsigned len, uint16_t bufindex, completion_t cb, bool fixed = false) {
+		struct io_uring_sqe* sqe = Prepare(IORING_OP_READ_FIXED, fd, dest, len, std::move(cb), fixed);
+		if (sqe == nullptr) {
+			return false;
+		}
+		sqe->buf_index = bufindex;
+		return true;
+	}
+
+	/// <summary>
+	/// Pushes every prepared SQE with one io_uring_enter and optionally waits for `wait` completions.
+	/// </summary>
+	int Submit(unsigned wait = 0) {
+		std::atomic_ref<unsigned> tail(*m_sqtail);
+		unsigned tosubmit = m_localtail - tail.load(std::memory_order_relaxed);
+		tail.store(m_localtail, std::memory_order_release);
+		if (tosubmit == 0 && wait == 0) {
+			return 0;
+		}
+		unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+		int ret = 0;
+		do {
+			ret = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, tosubmit, wait, flags, nullptr, 0));
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0) {
+			dbg_print();
+		}
+		return ret;
+	}
+	/// <summary>
+	/// Runs the callback of every completion already in the CQ ring. returns the count.
+	/// </summary>
+	int Reap() {
+		std::atomic_ref<unsigned> head(*m_cqhead);
+		std::atomic_ref<unsigned> tail(*m_cqtail);
+		int count = 0;
+		while (true) {
+			// callbacks may reap recursively, so re-read the head every iteration
+			unsigned h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) {
+				break;
+			}
+			const struct io_uring_cqe& cqe = m_cqes[h & m_cqmask];
+			uint64_t slot = cqe.user_data;
+			int res = cqe.res;
+			head.store(h + 1, std::memory_order_release);
+			Complete(slot, res);
+			++count;
+		}
+		return count;
+	}
+	int SubmitAndReap(unsigned wait = 1) {
+		if (Submit(wait) < 0) {
+			return -1;
+		}
+		return Reap();
+	}
+
+	/// <summary>
+	/// Prepares one operation and blocks until it completes. returns the CQE result (-errno on failure).
+	/// the completion owns its result, so a ring that fails to submit can still deliver it later.
+	/// </summary>
+	template<class F>
+	int Await(F&& prepare) {
+		auto state = std::make_shared<std::optional<int>>();
+		if (!prepare([state](int res) { *state = res; })) {
+			return -EBUSY;
+		}
+		while (!*state) {
+			if (Submit(1) < 0) {
+				int err = errno;
+				// a full CQ ring or a short allocation clears up once completions are reaped
+				if ((err != EAGAIN && err != EBUSY) || Reap() == 0) {
+					return -err;
+				}
+				continue;
+			}
+			Reap();
+		}
+		return **state;
+	}
+
+private:
+
+	static std::atomic<bool>& EnabledFlag() {
+		static std::atomic<bool> flag = true;
+		return flag;
+	}
+
+	void* Map(size_t size, off_t offset) {
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+		if (ptr == MAP_FAILED) {
+			dbg_print();
+			return nullptr;
+		}
+		return ptr;
+	}
+
+	bool Register(unsigned opcode, const void* arg, unsigned count) {
+		if (syscall(__NR_io_uring_register, m_fd, opcode, arg, count) < 0) {
+			dbg_print();
+			return false;
+		}
+		return true;
+	}
+	// kernels older than the probe (5.6) lack the socket opcodes as well, so a failed probe leaves all unsupported
+	void Probe() {
+		constexpr unsigned count = 256;
+		std::vector<char> buf(sizeof(struct io_uring_probe) + count * sizeof(struct io_uring_probe_op));
+		auto probe = reinterpret_cast<struct io_uring_probe*>(buf.data());
+		if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, count) < 0) {
+			return;
+		}
+		for (unsigned i = 0; i < probe->ops_len && i < count; ++i) {
+			m_supported[probe->ops[i].op] = (probe->ops[i].flags & IO_URING_OP_SUPPORTED) != 0;
+		}
+	}
+
+	struct io_uring_sqe* Prepare(uint8_t opcode, int fd, const void* addr, unsigned len, completion_t cb, bool fixed) {
+		std::atomic_ref<unsigned> head(*m_sqhead);
+		if (m_localtail - head.load(std::memory_order_acquire) >= m_sqentries) {
+			// SQ ring is full; hand the pending entries to the kernel to make room
+			Submit();
+			if (m_localtail - head.load(std::memory_order_acquire) >= m_sqentries) {
+				return nullptr;
+			}
+		}
+		unsigned idx = m_localtail & m_sqmask;
+		struct io_uring_sqe* sqe = &m_sqes[idx];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->addr = reinterpret_cast<uint64_t>(addr);
+		sqe->len = len;
+		sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+		sqe->user_data = Allocate(std::move(cb));
+		m_sqarray[idx] = idx;
+		++m_localtail;
+		return sqe;
+	}
+
+	uint64_t Allocate(completion_t cb) {
+		++m_inflight;
+		if (m_free.empty()) {
+			m_slots.push_back(std::move(cb));
+			return m_slots.size() - 1;
+		}
+		uint64_t slot = m_free.back();
+		m_free.pop_back();
+		m_slots[slot] = std::move(cb);
+		return slot;
+	}
+	void Complete(uint64_t slot, int res) {
+		completion_t cb = std::move(m_slots[slot]);
+		m_slots[slot] = nullptr;
+		m_free.push_back(slot);
+		--m_inflight;
+		if (cb) {
+			cb(res);
+		}
+	}
+
+	void Destroy() {
+		if (m_sqes != nullptr) {
+			munmap(m_sqes, m_sqentries * sizeof(struct io_uring_sqe));
+		}
+		if (m_cqring != nullptr && m_cqring != m_sqring) {
+			munmap(m_cqring, m_cqsize);
+		}
+		if (m_sqring != nullptr) {
+			munmap(m_sqring, m_sqsize);
+		}
+		if (m_fd >= 0) {
+			close(m_fd);
+		}
+		m_sqes = nullptr;
+		m_sqring = m_cqring = nullptr;
+		m_fd = -1;
+	}
+
+	int m_fd = -1;
+	unsigned m_sqentries = 0;
+	size_t m_sqsize = 0;
+	size_t m_cqsize = 0;
+	void* m_sqring = nullptr;
+	void* m_cqring = nullptr;
+
+	unsigned* m_sqhead = nullptr;
+	unsigned* m_sqtail = nullptr;
+	unsigned* m_sqarray = nullptr;
+	unsigned m_sqmask = 0;
+	unsigned m_localtail = 0;
+	struct io_uring_sqe* m_sqes = nullptr;
+
+	unsigned* m_cqhead = nullptr;
+	unsigned* m_cqtail = nullptr;
+	unsigned m_cqmask = 0;
+	struct io_uring_cqe* m_cqes = nullptr;
+
+	std::vector<completion_t> m_slots;
+	std::vector<uint64_t> m_free;
+	size_t m_inflight = 0;
+	std::array<bool, 256> m_supported{};
+};
+
+
+/// <summary>
+/// Socket Base with io_uring transport
+/// </summary>
+
+/// <summary>
+/// Functional io_uring backend: every call prepares one SQE on the thread's ring, submits it and waits for
+/// its completion, so it does not batch or use registered files (IOUring offers both to callers that do).
+/// that is no cheaper than the plain syscall, so it is never DefaultSocketBase: name it as sockbase explicitly.
+/// opcodes the kernel lacks fall back to the SocketBase syscall; other errors come back as errno.
+/// </summary>
+template<class ipT, Protocol _protocol>
+class URingSocketBase : public SocketBase<ipT, _protocol> {
+	using base = SocketBase<ipT, _protocol>;
+public:
+
+	URingSocketBase() : base() {}
+
+protected:
+
+	URingSocketBase(typename base::sock_t s) : base(s) {}
+
+	int SendSome(const void* src, int size, int flags = 0) {
+		return Submit(IORING_OP_SEND,
+			[&](IOUring& ring, IOUring::completion_t cb) { return ring.PrepareSend(base::sock(), src, static_cast<unsigned>(size), std::move(cb), flags); },
+			[&] { return base::SendSome(src, size, flags); });
+	}
+	int RecvSome(void* dest, int size, int flags = 0) {
+		return Submit(IORING_OP_RECV,
+			[&](IOUring& ring, IOUring::completion_t cb) { return ring.PrepareRecv(base::sock(), dest, static_cast<unsigned>(size), std::move(cb), flags); },
+			[&] { return base::RecvSome(dest, size, flags); });
+	}
+	int SendVector(const SocketDetail::byte_view* bufs, size_t count, int flags = 0) {
+		count = std::min(count, SocketTraits::MaxVector);
+		std::array<struct iovec, SocketTraits::MaxVector> iov;
+		struct msghdr msg{};
+		base::MakeMessage(msg, iov.data(), bufs, count);
+		return Submit(IORING_OP_SENDMSG,
+			[&](IOUring& ring, IOUring::completion_t cb) { return ring.PrepareSendMsg(base::sock(), &msg, std::move(cb), flags); },
+			[&] { return base::SendVector(bufs, count, flags); });
+	}
+	typename base::sock_t AcceptRaw(bool nonblocking = false) {
+		return Submit(IORING_OP_ACCEPT,
+			[&](IOUring& ring, IOUring::completion_t cb) { return ring.PrepareAccept(base::sock(), std::move(cb), nonblocking ? SOCK_NONBLOCK : 0); },
+			[&] { return base::AcceptRaw(nonblocking); });
+	}
+
+private:
+
+	template<class Prepare, class Fallback>
+	static int Submit(uint8_t opcode, Prepare&& prepare, Fallback&& fallback) {
+		IOUring* ring = IOUring::ThreadLocal();
+		if (ring == nullptr || !ring->Supports(opcode)) {
+			return fallback();
+		}
+		int res = ring->Await([&](IOUring::completion_t cb) { return prepare(*ring, std::move(cb)); });
+		if (res < 0) {
+			errno = -res;
+			return -1;
+		}
+		return res;
+	}
+
+};
+
+#endif // SOCKET_H_IO_URING
+
+template<class ipT, Protocol _protocol>
+using DefaultSocketBase = SocketBase<ipT, _protocol>;
+
+/// <summary>
+/// Receive Buffer
+/// </summary>
+
+/// <summary>
+/// Contiguous per-socket receive buffer. the storage is allocated on first use, compacted in place,
+/// and grown only when a single frame does not fit (then released again once drained).
+/// </summary>
+class RecvBuffer {
+public:
+	using byte_t = SocketDetail::byte_t;
+	using byte_view = SocketDetail::byte_view;
+	using byte_ref = SocketDetail::byte_ref;
+
+	static constexpr size_t DefaultCapacity = 16 * 1024;
+	static constexpr size_t MinFill = 2048;
+
+	explicit RecvBuffer(size_t capacity = DefaultCapacity) : m_default(capacity) {}
+
+	RecvBuffer(const RecvBuffer&) = delete;
+	RecvBuffer(RecvBuffer&& other) noexcept { *this = std::move(other); }
+	RecvBuffer& operator=(const RecvBuffer&) = delete;
+	RecvBuffer& operator=(RecvBuffer&& other) noexcept {
+		m_data = std::move(other.m_data);
+		m_capacity = std::exchange(other.m_capacity, 0);
+		m_head = std::exchange(other.m_head, 0);
+		m_tail = std::exchange(other.m_tail, 0);
+		m_default = other.m_default;
+		return *this;
+	}
+
+	size_t Size() const { return m_tail - m_head; }
+	size_t Capacity() const { return m_capacity; }
+	byte_view Data() const { return byte_view(m_data.get() + m_head, Size()); }
+
+	/// <summary>
+	/// Free space behind the buffered bytes, at least min bytes long.
+	/// </summary>
+	byte_ref Prepare(size_t min = MinFill) {
+		if (m_capacity - m_tail < min) {
+			Reserve(Size() + min);
+		}
+		return byte_ref(m_data.get() + m_tail, m_capacity - m_tail);
+	}
+	void Commit(size_t size) {
+		m_tail += size;
+	}
+	void Consume(size_t size) {
+		m_head += size;
+		if (m_head == m_tail) {
+			m_head = m_tail = 0;
+			if (m_capacity > m_default) {
+				m_data.reset();
+				m_capacity = 0;
+			}
+		}
+	}
+	size_t Read(void* dest, size_t size) {
+		size = std::min(size, Size());
+		if (size > 0) {
+			std::memcpy(dest, m_data.get() + m_head, size);
+			Consume(size);
+		}
+		return size;
+	}
+	/// <summary>
+	/// Makes room for size contiguous bytes starting at the buffered data.
+	/// </summary>
+	void Reserve(size_t size) {
+		size = std::max(size, m_default);
+		if (size <= m_capacity) {
+			if (m_capacity - m_head < size) {
+				std::memmove(m_data.get(), m_data.get() + m_head, Size());
+				m_tail -= m_head;
+				m_head = 0;
+			}
+			return;
+		}
+		auto data = std::make_unique_for_overwrite<byte_t[]>(size);
+		if (Size() > 0) {
+			std::memcpy(data.get(), m_data.get() + m_head, Size());
+		}
+		m_tail = Size();
+		m_head = 0;
+		m_data = std::move(data);
+		m_capacity = size;
+	}
+
+	std::optional<Header> PeekHeader() const {
+		if (Size() < Packet::HeaderSize) {
+			return std::nullopt;
+		}
+		Header ret;
+		std::memcpy(&ret, m_data.get() + m_head, Packet::HeaderSize);
+		return ret;
+	}
+	/// <summary>
+	/// Size of the frame at the front including its header, or 0 while the header is incomplete.
+	/// </summary>
+	size_t FrameSize() const {
+		auto head = PeekHeader();
+		return head ? Packet::HeaderSize + head->Size : 0;
+	}
+	bool HasFrame() const {
+		size_t size = FrameSize();
+		return size > 0 && Size() >= size;
+	}
+
+private:
+	std::unique_ptr<byte_t[]> m_data = nullptr;
+	size_t m_capacity = 0;
+	size_t m_head = 0;
+	size_t m_tail = 0;
+	size_t m_default = DefaultCapacity;
+};
+
+/// <summary>
+/// Send Queue
+/// </summary>
+
+/// <summary>
+/// Outbound frames of one socket. frames are shared buffers, so the same frame can sit in many queues.
+/// Push reports backpressure once the queued bytes reach the high watermark, and OnDrain fires
+/// when a backpressured queue falls back to the low watermark.
+/// </summary>
+class SendQueue {
+public:
+	using bytearray = SocketDetail::bytearray;
+	using byte_view = SocketDetail::byte_view;
+	using buffer_t = std::shared_ptr<const bytearray>;
+
+	static constexpr size_t DefaultLowWatermark = 64 * 1024;
+	static constexpr size_t DefaultHighWatermark = 1024 * 1024;
+
+	SendQueue(size_t low = DefaultLowWatermark, size_t high = DefaultHighWatermark) : m_low(low), m_high(high) {}
+
+	SendQueue& Watermarks(size_t low, size_t high) {
+		m_low = low;
+		m_high = high;
+		return *this;
+	}
+	size_t LowWatermark() const { return m_low; }
+	size_t HighWatermark() const { return m_high; }
+
+	/// <summary>
+	/// Appends a frame. returns false while the producer should back off (queued bytes >= high watermark).
+	/// </summary>
+	bool Push(buffer_t frame) {
+		if (frame && !frame->empty()) {
+			m_bytes += frame->size();
+			m_frames.push_back(std::move(frame));
+			if (m_latency) {
+				m_stamps.push_back(std::chrono::steady_clock::now());
+			}
+		}
+		if (m_bytes >= m_high) {
+			m_backpressured = true;
+		}
+		return !m_backpressured;
+	}
+
+	bool Empty() const { return m_frames.empty(); }
+	bool IsBackpressured() const { return m_backpressured; }
+
+	size_t QueuedBytes() const { return m_bytes; }
+	size_t QueuedPackets() const { return m_frames.size(); }
+	uint64_t SentBytes() const { return m_sentbytes; }
+	uint64_t SentPackets() const { return m_sentpackets; }
+
+	/// <summary>
+	/// Views of the unsent bytes of up to max frames from the front.
+	/// </summary>
+	size_t Gather(byte_view* bufs, size_t max) const {
+		size_t count = 0;
+		for (auto it = m_frames.begin(); it != m_frames.end() && count < max; ++it, ++count) {
+			bufs[count] = byte_view(**it).subspan(count == 0 ? m_offset : 0);
+		}
+		return count;
+	}
+	// also hands out the frames behind the views, for senders that must keep them alive after Advance
+	size_t Gather(byte_view* bufs, buffer_t* frames, size_t max) const {
+		size_t count = Gather(bufs, max);
+		std::copy_n(m_frames.begin(), count, frames);
+		return count;
+	}
+	void Advance(size_t size) {
+		m_bytes -= size;
+		m_sentbytes += size;
+		while (size > 0) {
+			size_t left = m_frames.front()->size() - m_offset;
+			if (size < left) {
+				m_offset += size;
+				break;
+			}
+			size -= left;
+			m_offset = 0;
+			m_frames.pop_front();
+			++m_sentpackets;
+			if (m_latency) {
+				m_latency->Record(std::chrono::steady_clock::now() - m_stamps.front());
+				m_stamps.pop_front();
+			}
+		}
+		if (m_backpressured && m_bytes <= m_low) {
+			m_backpressured = false;
+			if (OnDrain) {
+				OnDrain();
+			}
+		}
+	}
+	void Clear() {
+		m_frames.clear();
+		m_stamps.clear();
+		m_offset = 0;
+		m_bytes = 0;
+		m_backpressured = false;
+	}
+
+	std::function<void()> OnDrain;
+
+	/// <summary>
+	/// Records into latency how long every frame waited from Push until its last byte was written
+	/// (null stops). frames already queued count from now.
+	/// </summary>
+	void Measure(LatencyHistogram* latency) {
+		m_latency = latency;
+		m_stamps.assign(latency ? m_frames.size() : 0, std::chrono::steady_clock::now());
+	}
+
+private:
+	std::deque<buffer_t> m_frames;
+	std::deque<std::chrono::steady_clock::time_point> m_stamps;
+	LatencyHistogram* m_latency = nullptr;
+	size_t m_offset = 0;
+	size_t m_bytes = 0;
+	size_t m_low = DefaultLowWatermark;
+	size_t m_high = DefaultHighWatermark;
+	bool m_backpressured = false;
+	uint64_t m_sentbytes = 0;
+	uint64_t m_sentpackets = 0;
+};
+
+/// <summary>
+/// TCP Protocol Socket
+/// </summary>
+
+template<class ipT, class sockbase = DefaultSocketBase<ipT, Protocol::TCP>>
+class basic_TCPSocket : public sockbase {
+	template<class, class>
+	friend class basic_TCPServer;
+protected:
+
+	using sockbase::sockbase;
+
+public:
+
+	using bytearray = typename sockbase::bytearray;
+
+	// small frames go out at once; TCP_NODELAY does not exist for local sockets
+	basic_TCPSocket() : sockbase() {
+		if constexpr (sockbase::IPType::VersionValue != AF_UNIX) {
+			SocketTraits::SetOption(sockbase::Handle(), IPPROTO_TCP, TCP_NODELAY, 1);
+		}
+	}
+	basic_TCPSocket(typename sockbase::IPType addr) : basic_TCPSocket() {
+		Connect(addr);
+	}
+
+	basic_TCPSocket(const basic_TCPSocket&) = delete;
+	basic_TCPSocket(basic_TCPSocket&& other) noexcept : sockbase(std::move(other)), CryptEngine(std::move(other.CryptEngine)), m_recvbuf(std::move(other.m_recvbuf)), m_sendqueue(std::move(other.m_sendqueue)), m_writewatch(other.m_writewatch), m_corked(other.m_corked), m_zerocopy(std::move(other.m_zerocopy)), m_metrics(std::move(other.m_metrics)), m_arrival(other.m_arrival) {}
+
+	basic_TCPSocket& operator=(const basic_TCPSocket&) = delete;
+	basic_TCPSocket& operator=(basic_TCPSocket&& other) noexcept {
+		CryptEngine = std::move(other.CryptEngine);
+		m_recvbuf = std::move(other.m_recvbuf);
+		m_sendqueue = std::move(other.m_sendqueue);
+		m_writewatch = other.m_writewatch;
+		m_corked = other.m_corked;
+		m_zerocopy = std::move(other.m_zerocopy);
+		m_metrics = std::move(other.m_metrics);
+		m_arrival = other.m_arrival;
+		sockbase::operator=(std::move(other));
+		return *this;
+	}
+
+	/// <summary>
+	/// Connects to hostaddr. with timeout [ms] > 0 the handshake is abandoned after the deadline;
+	/// 0 or less blocks until the kernel gives up.
+	/// </summary>
+	bool Connect(typename sockbase::IPType hostaddr, int timeout = 0) {
+		if (timeout <= 0) {
+			if (connect(sockbase::sock(), hostaddr, hostaddr.Length()) < 0) {
+				dbg_print();
+				return false;
+			}
+			return true;
+		}
+
+		bool nonblocking = SocketTraits::IsNonBlocking(sockbase::sock());
+		SocketTraits::NonBlocking(sockbase::sock());
+		bool ret = ConnectUntil(hostaddr, timeout);
+		SocketTraits::NonBlocking(sockbase::sock(), nonblocking);
+		return ret;
+	}
+	/// <summary>
+	/// Reads until the kernel has nothing left and hands out every complete packet.
+	/// meant to be called from an EventLoop Readable callback. partial frames stay buffered.
+	/// returns the number of packets handed out, or -1 once the stream ended; error then tells why:
+	/// 0 when the peer closed, the socket error when the connection failed, EBADMSG when a payload did not decrypt.
+	/// </summary>
+	template<class F>
+	int RecvAll(F&& f, int* error = nullptr) {
+		return DrainFrames(std::forward<F>(f), false, error);
+	}
+	template<class F>
+	int EncryptionRecvAll(F&& f, int* error = nullptr) {
+		return DrainFrames(std::forward<F>(f), true, error);
+	}
+	/// <summary>
+	/// Hands every complete frame in the receive buffer to f(const Header&, byte_view) without copying.
+	/// reads once when no frame is complete yet. the views are valid only during the call.
+	/// returns the number of frames, or -1 when the connection is closed.
+	/// </summary>
+	template<class F>
+	int RecvViews(F&& f) {
+		if (!m_recvbuf.HasFrame()) {
+			m_recvbuf.Reserve(m_recvbuf.FrameSize());
+			if (Fill() <= 0) {
+				return -1;
+			}
+		}
+		int count = 0;
+		while (m_recvbuf.HasFrame()) {
+			Header head = *m_recvbuf.PeekHeader();
+			f(head, m_recvbuf.Data().subspan(Packet::HeaderSize, head.Size));
+			m_recvbuf.Consume(Packet::HeaderSize + head.Size);
+			++count;
+		}
+		return count;
+	}
+
+	int Available() const {
+#ifdef _MSC_BUILD
+		u_long bytes = 0;
+		if (ioctlsocket(sockbase::sock(), FIONREAD, &bytes) == SOCKET_ERROR) {
+			dbg_print();
+			return -1;
+		}
+		return static_cast<int>(bytes + m_recvbuf.Size());
+#else 
+		int bytes = 0;
+		if (ioctl(sockbase::sock(), FIONREAD, &bytes) < 0) {
+			dbg_print();
+			return -1;
+		}
+		return bytes + static_cast<int>(m_recvbuf.Size());
+#endif
+	}
+	// a whole packet is already buffered, so the next Recv() returns without touching the socket
+	bool HasBufferedPacket() const {
+		return m_recvbuf.HasFrame();
+	}
+	std::optional<typename sockbase::IPType> GetPeerAddress() {
+		typename sockbase::IPType ret;
+		socklen_t addrlen = sizeof(ret);
+		if (getpeername(sockbase::sock(), static_cast<sockaddr*>(ret), &addrlen) != 0) {
+			return std::nullopt;
+		}
+		return ret;
+	}
+	bool LostConnection() {
+		// queued zero copy completions raise POLLERR as well
+		if (!m_zerocopy.pins.empty()) {
+			ReapZeroCopy();
+		}
+		int ret = sockbase::Poll(std::addressof(sockbase::pfd), 1, 0);
+
+		if (ret == 0) {
+			return false;
+		}
+
+		if (ret < 0) {
+			dbg_print();
+			int err = _last_error();
+#ifdef _MSC_BUILD
+			if (err == WSAEINTR)
+#else
+			if (err == EINTR)
+#endif
+			{
+				return false;
+			}
+			return true;
+		}
+
+		if (sockbase::pfd.revents & POLLHUP) {
+			return true;
+		}
+		if ((sockbase::pfd.revents & POLLERR) && PollError()) {
+			return true;
+		}
+
+		if (sockbase::pfd.revents & POLLIN) {
+			char buf;
+			int r = recv(sockbase::sock(), &buf, 1, MSG_PEEK);
+			if (r == 0) {
+				return true;
+			}
+			if (r < 0) {
+				int err = _last_error();
+#ifdef _MSC_BUILD
+				if (err == WSAECONNRESET)
+#else
+				if (err == ECONNRESET)
+#endif
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+	// RawSend / RawSendV / Send(bytearray) end a write of their own, so a corked socket pushes after them
+	bool RawSend(const void* src, int size) {
+		return Pushed(WriteAll(src, size));
+	}
+	bool RawRecv(void* dest, int size) {
+		trace_scope("TCPSocket::RawRecv", size);
+		int received = static_cast<int>(m_recvbuf.Read(dest, size));
+		while (received < size) {
+			int ret = Received(sockbase::RecvSome(static_cast<char*>(dest) + received, size - received));
+			if (ret <= 0) { return false; }
+			received += ret;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Sends every buffer in order with vectored writes, without concatenating them first.
+	/// </summary>
+	bool RawSendV(std::span<const SocketDetail::byte_view> bufs) {
+		return Pushed(WriteAllV(bufs));
+	}
+
+	bool Send(const bytearray& src) {
+		return RawSend(src.data(), static_cast<int>(src.size()));
+	}
+	bool Recv(bytearray& dest) {
+		if (dest.empty()) { return false; }
+		return RawRecv(dest.data(), static_cast<int>(dest.size()));
+	}
+
+	/// <summary>
+	/// Above the zero copy threshold the call waits until the kernel released the buffer of src
+	/// (usually once the peer acknowledged it). Send(Packet&&) and QueueSend do not wait.
+	/// </summary>
+	bool Send(const Packet& src) {
+		if (src.CheckHeader()) {
+			return false;
+		}
+		if (UseZeroCopy(src.GetBuffer().size())) {
+			return SentPacket(ZeroCopySend(src.GetBuffer(), nullptr) && WaitZeroCopy());
+		}
+		return SentPacket(WriteAll(src.GetBuffer().data(), static_cast<int>(src.GetBuffer().size())));
+	}
+	bool Send(Packet&& src) {
+		if (src.CheckHeader()) {
+			return false;
+		}
+		if (UseZeroCopy(src.GetBuffer().size())) {
+			return Send(std::make_shared<const bytearray>(src.ReleaseBuffer()));
+		}
+		return Send(static_cast<const Packet&>(src));
+	}
+	// sends a shared frame as it is; above the zero copy threshold the socket keeps it alive until the kernel is done with it
+	bool Send(SendQueue::buffer_t frame) {
+		if (!frame) {
+			return false;
+		}
+		if (UseZeroCopy(frame->size())) {
+			return SentPacket(ZeroCopySend(*frame, frame));
+		}
+		return SentPacket(WriteAll(frame->data(), static_cast<int>(frame->size())));
+	}
+	/// <summary>
+	/// Sends a packet made of head and the payload spans in one vectored write. head.Size is filled in.
+	/// </summary>
+	bool Send(Header head, std::span<const SocketDetail::byte_view> payloads) {
+		size_t size = 0;
+		for (auto&& p : payloads) {
+			size += p.size();
+		}
+		if (size > UINT32_MAX) {
+			return false;
+		}
+		head.Size = static_cast<uint32_t>(size);
+
+		std::array<SocketDetail::byte_view, SocketTraits::MaxVector> bufs;
+		bufs[0] = SocketDetail::byte_view(reinterpret_cast<const SocketDetail::byte_t*>(&head), Packet::HeaderSize);
+		if (payloads.size() < bufs.size()) {
+			std::copy(payloads.begin(), payloads.end(), bufs.begin() + 1);
+			return SentPacket(WriteAllV(std::span(bufs.data(), payloads.size() + 1)));
+		}
+		return SentPacket(WriteAllV(std::span(bufs.data(), 1)) && WriteAllV(payloads));
+	}
+	bool Send(Header head, std::initializer_list<SocketDetail::byte_view> payloads) {
+		return Send(head, std::span(payloads.begin(), payloads.size()));
+	}
+	std::optional<Packet> Recv() {
+		trace_scope("TCPSocket::Recv", 0);
+		std::optional<Packet> ret = RecvFrame(false);
+		trace_bytes(ret ? ret->GetBuffer().size() : 0);
+		return ret;
+	}
+	/// <summary>
+	/// Waits up to timeout [ms] (-1 = infinite) for a whole packet. on timeout the bytes received so far
+	/// stay buffered for the next call.
+	/// </summary>
+	std::optional<Packet> Recv(int timeout) {
+		return RecvFrameUntil(SocketTraits::Deadline(timeout), false);
+	}
+
+	/// <summary>
+	/// Sends the header of src, then the file straight from the page cache (sendfile on linux).
+	/// false after the header went out means the stream is out of sync and the connection should be closed.
+	/// </summary>
+	bool Send(const FilePacket& src) {
+		if (!src.IsValid()) {
+			return false;
+		}
+		Header head = src.GetHeader();
+#ifdef _MSC_BUILD
+		std::ifstream ifs(src.Path(), std::ios::binary);
+		if (!ifs.is_open()) {
+			dbg_print();
+			return false;
+		}
+		return SentPacket(WriteAll(&head, static_cast<int>(Packet::HeaderSize)) && SendFileChunks(ifs, head.Size));
+#else
+		int fd = open(src.Path().c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			dbg_print();
+			return false;
+		}
+		bool ret = WriteAll(&head, static_cast<int>(Packet::HeaderSize)) && SendFileRange(fd, head.Size);
+		close(fd);
+		return SentPacket(ret);
+#endif // _MSC_BUILD
+	}
+	/// <summary>
+	/// Receives the next packet and writes its payload to path chunk by chunk instead of holding it in memory
+	/// (spliced from the socket on linux). returns the header, or nullopt when the connection or the file failed.
+	/// the payload is consumed either way, so the stream stays in sync when only the file failed.
+	/// </summary>
+	std::optional<Header> RecvFile(const std::filesystem::path& path) {
+		while (m_recvbuf.Size() < Packet::HeaderSize) {
+			if (Fill() <= 0) {
+				return std::nullopt;
+			}
+		}
+		Header head = *m_recvbuf.PeekHeader();
+		m_recvbuf.Consume(Packet::HeaderSize);
+
+#ifdef _MSC_BUILD
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		bool writable = ofs.is_open();
+		auto write = [&](const SocketDetail::byte_t* src, size_t size) {
+			writable = writable && ofs.write(reinterpret_cast<const char*>(src), size);
+		};
+#else
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		bool writable = fd >= 0;
+		auto write = [&](const SocketDetail::byte_t* src, size_t size) {
+			while (writable && size > 0) {
+				ssize_t ret = ::write(fd, src, size);
+				if (ret < 0 && errno == EINTR) {
+					continue;
+				}
+				if (ret <= 0) {
+					writable = false;
+					break;
+				}
+				src += ret;
+				size -= static_cast<size_t>(ret);
+			}
+		};
+#endif // _MSC_BUILD
+		if (!writable) {
+			dbg_print();
+		}
+
+		uint64_t left = head.Size;
+		size_t buffered = std::min<uint64_t>(left, m_recvbuf.Size());
+		write(m_recvbuf.Data().data(), buffered);
+		m_recvbuf.Consume(buffered);
+		left -= buffered;
+
+		bool connected = true;
+#ifdef __linux__
+		if (writable) {
+			connected = SpliceTo(fd, left, writable);
+		}
+#endif // __linux__
+		if (connected && left > 0) {
+			connected = RecvChunks(left, write);
+		}
+#ifndef _MSC_BUILD
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif // _MSC_BUILD
+		if (!connected || !writable) {
+			return std::nullopt;
+		}
+		return head;
+	}
+
+	// Queued API. frames wait in the outbound queue until Flush() writes them without blocking,
+	// coalescing as many as fit into one vectored write. the return value is the backpressure signal.
+
+	bool QueueSend(const Packet& src) {
+		if (src.CheckHeader()) {
+			return false;
+		}
+		return QueueSend(std::make_shared<const bytearray>(src.GetBuffer()));
+	}
+	bool QueueSend(Packet&& src) {
+		if (src.CheckHeader()) {
+			return false;
+		}
+		return QueueSend(std::make_shared<const bytearray>(src.ReleaseBuffer()));
+	}
+	bool QueueSend(SendQueue::buffer_t frame) {
+		return m_sendqueue.Push(std::move(frame));
+	}
+	bool QueueEncryptionSend(const Packet& src) {
+		if (src.CheckHeader()) {
+			return false;
+		}
+		auto frame = std::make_shared<bytearray>(src.GetBuffer());
+		SocketDetail::byte_ref payload = SocketDetail::byte_ref(*frame).subspan(Packet::HeaderSize);
+		if (!Encrypt(payload, payload)) {
+			return false;
+		}
+		return QueueSend(std::move(frame));
+	}
+	/// <summary>
+	/// Writes queued frames until the queue is empty or the socket would block.
+	/// returns false when the connection failed.
+	/// </summary>
+	bool Flush() {
+		std::array<SocketDetail::byte_view, SocketTraits::MaxVector> bufs;
+		bool sended = false;
+		if (!m_zerocopy.pins.empty()) {
+			ReapZeroCopy();
+		}
+		while (!m_sendqueue.Empty()) {
+			int ret;
+			if (m_zerocopy.threshold != 0) {
+				ret = FlushZeroCopy(bufs);
+			}
+			else {
+				size_t count = m_sendqueue.Gather(bufs.data(), bufs.size());
+				ret = Sent(sockbase::SendVector(bufs.data(), count, SocketTraits::DontWait), bufs.data(), count);
+			}
+			if (ret < 0) {
+				return SocketTraits::WouldBlock(_last_error());
+			}
+			uint64_t packets = m_sendqueue.SentPackets();
+			m_sendqueue.Advance(static_cast<size_t>(ret));
+			if (m_metrics) {
+				SocketMetrics::Add(m_metrics->PacketsOut, m_sendqueue.SentPackets() - packets);
+			}
+			sended = true;
+		}
+		if (sended && m_corked) {
+			Push();
+		}
+		return true;
+	}
+	/// <summary>
+	/// Flush() and keep the Writable interest in the loop only while frames are pending.
+	/// false as well when the interest could not be changed (e.g. the socket is not registered with loop),
+	/// since the pending frames would then never be flushed.
+	/// </summary>
+	bool Flush(EventLoop& loop) {
+		if (!Flush()) {
+			return false;
+		}
+		bool pending = !m_sendqueue.Empty();
+		if (pending != m_writewatch) {
+			if (!loop.Modify(sockbase::Handle(), pending)) {
+				return false;
+			}
+			m_writewatch = pending;
+		}
+		return true;
+	}
+	SendQueue& OutboundQueue() {
+		return m_sendqueue;
+	}
+
+	/// <summary>
+	/// Starts counting into metrics (null stops), e.g. the metrics of a MetricsGroup::Attach.
+	/// off by default: a socket without metrics pays one pointer test per call.
+	/// </summary>
+	void Metrics(std::shared_ptr<SocketMetrics> metrics) {
+		m_metrics = std::move(metrics);
+		m_sendqueue.Measure(m_metrics ? &m_metrics->SendToFlush : nullptr);
+	}
+	// counts into metrics of its own unless some are attached already
+	SocketMetrics& EnableMetrics() {
+		if (!m_metrics) {
+			Metrics(std::make_shared<SocketMetrics>());
+		}
+		return *m_metrics;
+	}
+	const SocketMetrics* Metrics() const {
+		return m_metrics.get();
+	}
+
+	// SocketBase::Apply that also remembers whether Flush has to push corked segments out
+	bool Apply(const SocketOptions& options) {
+		if (options.Cork) {
+			m_corked = *options.Cork;
+		}
+		return sockbase::Apply(options);
+	}
+	/// <summary>
+	/// Sends the partial segment a corked socket is holding back, and stays corked.
+	/// </summary>
+	bool Push() {
+#if defined(TCP_CORK)
+		return SocketTraits::SetOption(sockbase::Handle(), IPPROTO_TCP, TCP_CORK, 0) && SocketTraits::SetOption(sockbase::Handle(), IPPROTO_TCP, TCP_CORK, 1);
+#elif defined(TCP_NOPUSH)
+		return SocketTraits::SetOption(sockbase::Handle(), IPPROTO_TCP, TCP_NOPUSH, 0) && SocketTraits::SetOption(sockbase::Handle(), IPPROTO_TCP, TCP_NOPUSH, 1);
+#else
+		return true;
+#endif
+	}
+	const SendQueue& OutboundQueue() const {
+		return m_sendqueue;
+	}
+
+	// Zero copy. sends of at least the threshold go out with MSG_ZEROCOPY: the kernel transmits straight
+	// from the buffer, which the socket pins until the completion arrives on the error queue.
+	// the completions are read by Flush, the sends themselves, LostConnection and ReapZeroCopy.
+	// closing the socket with buffers still pinned may put bytes of freed memory on the wire; WaitZeroCopy first.
+
+	static constexpr size_t DefaultZeroCopyThreshold = 64 * 1024;
+
+	/// <summary>
+	/// Turns zero copy sends on for payloads of threshold bytes or more (0 turns them off).
+	/// false where SO_ZEROCOPY is not supported (non-linux, unix domain sockets, kernels before 4.14).
+	/// </summary>
+	bool ZeroCopy(size_t threshold = DefaultZeroCopyThreshold) {
+#ifdef __linux__
+		if (threshold != 0 && !SocketTraits::SetOption(sockbase::Handle(), SOL_SOCKET, SO_ZEROCOPY, 1)) {
+			return false;
+		}
+		m_zerocopy.threshold = threshold;
+		return true;
+#else
+		return threshold == 0;
+#endif // __linux__
+	}
+	size_t ZeroCopyThreshold() const {
+		return m_zerocopy.threshold;
+	}
+	// buffers the kernel has not released yet
+	size_t ZeroCopyPending() const {
+		return m_zerocopy.pins.size();
+	}
+	uint64_t ZeroCopySends() const {
+		return m_zerocopy.sends;
+	}
+	// zero copy sends the kernel copied after all (loopback, devices without scatter-gather).
+	// when most sends end up here, zero copy only costs and should be turned off
+	uint64_t ZeroCopyCopied() const {
+		return m_zerocopy.copied;
+	}
+
+	/// <summary>
+	/// Reads the completions queued so far without blocking and releases the buffers they cover.
+	/// returns the number of released buffers.
+	/// </summary>
+	size_t ReapZeroCopy() {
+		size_t released = 0;
+#ifdef __linux__
+		while (!m_zerocopy.pins.empty()) {
+			alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))] = {};
+			struct msghdr msg = {};
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			if (recvmsg(sockbase::sock(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+				break;
+			}
+			for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+				if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+					continue;
+				}
+				struct sock_extended_err err;
+				std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+				if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+					continue;
+				}
+				// ids [ee_info, ee_data] are done. the subtraction keeps the range valid across the 32 bit wrap
+				++m_zerocopy.completions;
+				uint32_t count = err.ee_data - err.ee_info;
+				if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+					m_zerocopy.copied += uint64_t(count) + 1;
+				}
+				for (auto&& pin : m_zerocopy.pins) {
+					if (pin.id - err.ee_info <= count) {
+						pin.done = true;
+					}
+				}
+			}
+			while (!m_zerocopy.pins.empty() && m_zerocopy.pins.front().done) {
+				m_zerocopy.pins.pop_front();
+				++released;
+			}
+		}
+#endif // __linux__
+		return released;
+	}
+	/// <summary>
+	/// Sorts out a POLLERR: reaps the zero copy completions that may have raised it and returns true
+	/// only when the connection failed (SO_ERROR set, or no completion was queued).
+	/// </summary>
+	bool PollError() {
+		uint64_t completions = m_zerocopy.completions;
+		ReapZeroCopy();
+		return SocketTraits::PendingError(sockbase::Handle()) != 0 || m_zerocopy.completions == completions;
+	}
+	/// <summary>
+	/// Waits up to timeout [ms] (-1 = infinite) until every pinned buffer is released.
+	/// false on timeout or when the connection went away first.
+	/// </summary>
+	bool WaitZeroCopy(int timeout = -1) {
+		SocketTraits::deadline_t deadline = SocketTraits::Deadline(timeout);
+		while (ReapZeroCopy(), !m_zerocopy.pins.empty()) {
+			// completions raise POLLERR, which poll reports without being asked for
+			SocketTraits::poll_t p{};
+			p.fd = sockbase::sock();
+			if (sockbase::Poll(&p, 1, SocketTraits::Remaining(deadline)) <= 0) {
+				return false;
+			}
+			if ((p.revents & (POLLHUP | POLLNVAL)) && ReapZeroCopy() == 0) {
+				return m_zerocopy.pins.empty();
+			}
+		}
+		return true;
+	}
+
+	bool EncryptionSend(const bytearray& src) {
+		trace_scope("TCPSocket::EncryptionSend", src.size());
+		bytearray target;
+		return Encrypt(src, target) && Send(target);
+	}
+	bool EncryptionRecv(bytearray& dest) {
+		return Recv(dest) && Decrypt(dest, dest);
+	}
+
+	bool EncryptionSend(const Packet& src) {
+		trace_scope("TCPSocket::EncryptionSend", src.GetBuffer().size());
+		if (src.CheckHeader()) {
+			return false;
+		}
+		bytearray data(src.Payload().size());
+		return Encrypt(src.Payload(), data) && Send(*src.GetHeader(), {data});
+	}
+	/// <summary>
+	/// Encrypts the payload spans as one stream (CTR restarts per call) and sends them behind head.
+	/// </summary>
+	bool EncryptionSend(Header head, std::span<const SocketDetail::byte_view> payloads) {
+		trace_scope("TCPSocket::EncryptionSend", 0);
+		bytearray data;
+		for (auto&& p : payloads) {
+			data.insert(data.end(), p.begin(), p.end());
+		}
+		trace_bytes(data.size());
+		return Encrypt(data, data) && Send(head, {data});
+	}
+	bool EncryptionSend(Header head, std::initializer_list<SocketDetail::byte_view> payloads) {
+		return EncryptionSend(head, std::span(payloads.begin(), payloads.size()));
+	}
+	std::optional<Packet> EncryptionRecv() {
+		return RecvFrame(true);
+	}
+	std::optional<Packet> EncryptionRecv(int timeout) {
+		return RecvFrameUntil(SocketTraits::Deadline(timeout), true);
+	}
+
+#ifndef _MSC_BUILD
+	// descriptor passing (SCM_RIGHTS), unix domain sockets only
+
+	static constexpr size_t MaxDescriptors = 64;
+
+	/// <summary>
+	/// Sends src with fds attached to its first byte. the receiver gets duplicates of the descriptors;
+	/// the caller still owns (and should close) its own.
+	/// </summary>
+	bool Send(const Packet& src, std::span<const int> fds) requires (sockbase::IPType::VersionValue == AF_UNIX) {
+		if (src.CheckHeader() || fds.size() > MaxDescriptors) {
+			return false;
+		}
+		if (fds.empty()) {
+			return Send(src);
+		}
+		const bytearray& buf = src.GetBuffer();
+		struct iovec iov = {const_cast<SocketDetail::byte_t*>(buf.data()), buf.size()};
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxDescriptors)] = {};
+		struct msghdr msg = {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+		std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+		ssize_t ret;
+		do {
+			ret = Sent(static_cast<int>(sendmsg(sockbase::sock(), &msg, MSG_NOSIGNAL)), buf.size());
+		} while (ret < 0 && errno == EINTR);
+		if (ret <= 0) {
+			dbg_print();
+			return false;
+		}
+		// the descriptors went with the first byte; the rest is a plain stream write
+		size_t sended = static_cast<size_t>(ret);
+		return SentPacket(sended == buf.size() || WriteAll(buf.data() + sended, static_cast<int>(buf.size() - sended)));
+	}
+	/// <summary>
+	/// Receives one packet and appends every descriptor that arrived while reading it to fds
+	/// (close-on-exec on linux). descriptors sent to a plain Recv() are closed by the kernel.
+	/// </summary>
+	std::optional<Packet> Recv(std::vector<int>& fds) requires (sockbase::IPType::VersionValue == AF_UNIX) {
+		size_t received = fds.size();
+		while (!m_recvbuf.HasFrame()) {
+			m_recvbuf.Reserve(m_recvbuf.FrameSize());
+			if (FillRights(fds) <= 0) {
+				for (size_t i = received; i < fds.size(); ++i) {
+					::close(fds[i]);
+				}
+				fds.resize(received);
+				return std::nullopt;
+			}
+		}
+		return DecodeFrame(false);
+	}
+#endif // _MSC_BUILD
+
+	// Coroutine API. suspends on readiness from the event loop instead of blocking a thread.
+	// packets are taken by value, so the caller does not need to keep them alive.
+
+	Task<bool> AsyncSend(bytearray src, EventLoop& loop = EventLoop::Current()) {
+		co_return Pushed(co_await AsyncRawSend(src, loop));
+	}
+	Task<bool> AsyncSend(Packet src, EventLoop& loop = EventLoop::Current()) {
+		if (src.CheckHeader()) {
+			co_return false;
+		}
+		co_return SentPacket(co_await AsyncRawSend(src.GetBuffer(), loop));
+	}
+	Task<std::optional<Packet>> AsyncRecv(EventLoop& loop = EventLoop::Current()) {
+		return AsyncRecvFrame(loop, false);
+	}
+
+	Task<bool> AsyncEncryptionSend(Packet src, EventLoop& loop = EventLoop::Current()) {
+		if (src.CheckHeader()) {
+			co_return false;
+		}
+		// encrypt the payload in place behind a copy of the header, so the frame is built once
+		bytearray frame = src.GetBuffer();
+		SocketDetail::byte_ref payload = SocketDetail::byte_ref(frame).subspan(Packet::HeaderSize);
+		if (!Encrypt(payload, payload)) {
+			co_return false;
+		}
+		co_return SentPacket(co_await AsyncRawSend(frame, loop));
+	}
+	Task<std::optional<Packet>> AsyncEncryptionRecv(EventLoop& loop = EventLoop::Current()) {
+		return AsyncRecvFrame(loop, true);
+	}
+
+	// std::async based API. every call occupies a thread and captures its arguments by reference.
+
+	std::future<bool> ASyncSend(const bytearray& src) {
+		return std::async(std::launch::async, [&]() {
+			return this->Send(src);
+		});
+	}
+	std::future<bool> ASyncRecv(bytearray& dest) {
+		return std::async(std::launch::async, [&]() {
+			return this->Recv(dest);
+		});
+	}
+
+	std::future<bool> ASyncSend(const Packet& src) {
+		return std::async(std::launch::async, [&]() {
+			return this->Send(src);
+		});
+	}
+	std::future<std::optional<Packet>> ASyncRecv() {
+		return std::async(std::launch::async, [&]() {
+			return this->Recv();
+		});
+	}
+
+	std::future<bool> ASyncEncryptionSend(const bytearray& src) {
+		return std::async(std::launch::async, [&]() {
+			return this->EncryptionSend(src);
+		});
+	}
+	std::future<bool> ASyncEncryptionRecv(bytearray& dest) {
+		return std::async(std::launch::async, [&]() {
+			return this->EncryptionRecv(dest);
+		});
+	}
+
+	std::future<bool> ASyncEncryptionSend(const Packet& src) {
+		return std::async(std::launch::async, [&]() {
+			return this->EncryptionSend(src);
+		});
+	}
+	std::future<std::optional<Packet>> ASyncEncryptionRecv() {
+		return std::async(std::launch::async, [&]() {
+			return this->EncryptionRecv();
+		});
+	}
+
+	AES128 CryptEngine;
+
+protected:
+
+	bool UseZeroCopy(size_t size) const {
+		return m_zerocopy.threshold != 0 && size >= m_zerocopy.threshold;
+	}
+	/// <summary>
+	/// Blocking MSG_ZEROCOPY write of all of data, pinning frame (null for a buffer the caller waits on)
+	/// once per send call. falls back to a copying send when the kernel is out of notification memory.
+	/// </summary>
+	bool ZeroCopySend(SocketDetail::byte_view data, const SendQueue::buffer_t& frame) {
+		if (!m_zerocopy.pins.empty()) {
+			ReapZeroCopy();
+		}
+		while (!data.empty()) {
+			SocketDetail::byte_view chunk = data.first(std::min<size_t>(data.size(), INT_MAX));
+			int ret = Sent(sockbase::SendVector(&chunk, 1, SocketTraits::ZeroCopy), chunk.size());
+			if (ret < 0 && _last_error() == ENOBUFS) {
+				ret = Sent(sockbase::SendSome(chunk.data(), static_cast<int>(chunk.size())), chunk.size());
+			}
+			else if (ret > 0) {
+				Pin(frame);
+			}
+			if (ret <= 0) {
+				return false;
+			}
+			data = data.subspan(static_cast<size_t>(ret));
+		}
+		return true;
+	}
+	/// <summary>
+	/// One non-blocking vectored write of the queue front for Flush. MSG_ZEROCOPY when the gathered
+	/// frames reach the threshold, and then every frame the write touched is pinned.
+	/// </summary>
+	int FlushZeroCopy(std::array<SocketDetail::byte_view, SocketTraits::MaxVector>& bufs) {
+		std::array<SendQueue::buffer_t, SocketTraits::MaxVector> frames;
+		size_t count = m_sendqueue.Gather(bufs.data(), frames.data(), bufs.size());
+		size_t total = 0;
+		for (size_t i = 0; i < count; ++i) {
+			total += bufs[i].size();
+		}
+		if (!UseZeroCopy(total)) {
+			return Sent(sockbase::SendVector(bufs.data(), count, SocketTraits::DontWait), total);
+		}
+		int ret = Sent(sockbase::SendVector(bufs.data(), count, SocketTraits::DontWait | SocketTraits::ZeroCopy), total);
+		if (ret < 0 && _last_error() == ENOBUFS) {
+			return Sent(sockbase::SendVector(bufs.data(), count, SocketTraits::DontWait), total);
+		}
+		if (ret > 0) {
+			uint32_t id = m_zerocopy.next;
+			size_t left = static_cast<size_t>(ret);
+			for (size_t i = 0; i < count && left > 0; ++i) {
+				left -= std::min(left, bufs[i].size());
+				Pin(std::move(frames[i]), id);
+			}
+			++m_zerocopy.next;
+			++m_zerocopy.sends;
+		}
+		return ret;
+	}
+	// every send with MSG_ZEROCOPY that wrote a byte takes the next notification id
+	void Pin(SendQueue::buffer_t frame) {
+		Pin(std::move(frame), m_zerocopy.next++);
+		++m_zerocopy.sends;
+	}
+	void Pin(SendQueue::buffer_t frame, uint32_t id) {
+		m_zerocopy.pins.push_back(ZeroCopyPin{id, std::move(frame)});
+	}
+
+	/// <summary>
+	/// One recv into the receive buffer. returns the bytes read, 0 on orderly shutdown, -1 on error.
+	/// </summary>
+	int Fill(int flags = 0) {
+		SocketDetail::byte_ref space = m_recvbuf.Prepare();
+		int ret = Received(sockbase::RecvSome(space.data(), static_cast<int>(std::min<size_t>(space.size(), INT_MAX)), flags));
+		if (ret > 0) {
+			m_recvbuf.Commit(static_cast<size_t>(ret));
+		}
+		return ret;
+	}
+
+#ifndef _MSC_BUILD
+	// Fill() through recvmsg, collecting SCM_RIGHTS descriptors into fds
+	int FillRights(std::vector<int>& fds) {
+		SocketDetail::byte_ref space = m_recvbuf.Prepare();
+		struct iovec iov = {space.data(), space.size()};
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxDescriptors)];
+		struct msghdr msg = {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+#ifdef MSG_CMSG_CLOEXEC
+		constexpr int flags = MSG_CMSG_CLOEXEC;
+#else
+		constexpr int flags = 0;
+#endif // MSG_CMSG_CLOEXEC
+		ssize_t ret;
+		do {
+			ret = Received(static_cast<int>(recvmsg(sockbase::sock(), &msg, flags)));
+		} while (ret < 0 && errno == EINTR);
+		if (ret <= 0) {
+			return static_cast<int>(ret);
+		}
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+				continue;
+			}
+			size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			size_t first = fds.size();
+			fds.resize(first + count);
+			std::memcpy(fds.data() + first, CMSG_DATA(cmsg), sizeof(int) * count);
+		}
+		if (msg.msg_flags & MSG_CTRUNC) {
+			dbg_print();
+		}
+		m_recvbuf.Commit(static_cast<size_t>(ret));
+		return static_cast<int>(ret);
+	}
+#endif // _MSC_BUILD
+
+	std::optional<Packet> MakePacket(bytearray&& frame, bool decrypt) {
+		if (decrypt) {
+			SocketDetail::byte_ref payload = SocketDetail::byte_ref(frame).subspan(Packet::HeaderSize);
+			if (!Decrypt(payload, payload)) {
+				return std::nullopt;
+			}
+		}
+		Packet pak;
+		pak.SetBuffer(std::move(frame));
+		if (m_metrics) {
+			SocketMetrics::Add(m_metrics->PacketsIn, 1);
+			m_metrics->RecvToDispatch.Record(std::chrono::steady_clock::now() - m_arrival);
+		}
+		return pak;
+	}
+	// takes the complete frame at the front of the receive buffer
+	std::optional<Packet> DecodeFrame(bool decrypt) {
+		size_t framesize = m_recvbuf.FrameSize();
+		SocketDetail::byte_view data = m_recvbuf.Data();
+		bytearray frame(data.begin(), data.begin() + framesize);
+		m_recvbuf.Consume(framesize);
+		return MakePacket(std::move(frame), decrypt);
+	}
+	std::optional<Packet> RecvFrame(bool decrypt) {
+		while (m_recvbuf.Size() < Packet::HeaderSize) {
+			if (Fill() <= 0) {
+				return std::nullopt;
+			}
+		}
+		size_t framesize = m_recvbuf.FrameSize();
+		bytearray frame(framesize);
+		size_t received = m_recvbuf.Read(frame.data(), framesize);
+		while (received < framesize) {
+			size_t left = framesize - received;
+			if (left >= RecvBuffer::DefaultCapacity) {
+				// large payloads are read straight into the packet instead of through the buffer
+				if (!RawRecv(frame.data() + received, static_cast<int>(left))) {
+					return std::nullopt;
+				}
+				break;
+			}
+			if (Fill() <= 0) {
+				return std::nullopt;
+			}
+			received += m_recvbuf.Read(frame.data() + received, left);
+		}
+		return MakePacket(std::move(frame), decrypt);
+	}
+	std::optional<Packet> RecvFrameUntil(SocketTraits::deadline_t deadline, bool decrypt) {
+		while (!m_recvbuf.HasFrame()) {
+			m_recvbuf.Reserve(m_recvbuf.FrameSize());
+			if (!sockbase::WaitReadable(SocketTraits::Remaining(deadline))) {
+				return std::nullopt;
+			}
+			// readiness was just reported, so this recv returns without blocking even on winsock
+			int ret = Fill(SocketTraits::DontWait);
+			if (ret == 0 || (ret < 0 && !SocketTraits::WouldBlock(_last_error()))) {
+				return std::nullopt;
+			}
+		}
+		return DecodeFrame(decrypt);
+	}
+	template<class F>
+	int DrainFrames(F&& f, bool decrypt, int* error) {
+		auto ended = [error](int err) {
+			if (error != nullptr) {
+				*error = err;
+			}
+			return -1;
+		};
+		int count = 0;
+		while (true) {
+			while (m_recvbuf.HasFrame()) {
+				// only a payload that does not decrypt fails here; the frames behind it stay buffered
+				auto pak = DecodeFrame(decrypt);
+				if (!pak) {
+					return ended(EBADMSG);
+				}
+				f(std::move(*pak));
+				++count;
+			}
+			m_recvbuf.Reserve(m_recvbuf.FrameSize());
+			int ret = Fill(SocketTraits::DontWait);
+			if (ret > 0) {
+				continue;
+			}
+			if (ret == 0) {
+				return ended(0);
+			}
+			int err = _last_error();
+			if (SocketTraits::WouldBlock(err)) {
+				return count;
+			}
+			if (!SocketTraits::Interrupted(err)) {
+				return ended(err);
+			}
+		}
+	}
+	Task<std::optional<Packet>> AsyncRecvFrame(EventLoop& loop, bool decrypt) {
+		while (!m_recvbuf.HasFrame()) {
+			m_recvbuf.Reserve(m_recvbuf.FrameSize());
+			int ret = Fill(SocketTraits::DontWait);
+			if (ret > 0) {
+				continue;
+			}
+			if (ret < 0 && SocketTraits::WouldBlock(_last_error())) {
+				auto ready = loop.Readable(sockbase::Handle());
+				if (!co_await ready) {
+					co_return std::nullopt;
+				}
+				continue;
+			}
+			co_return std::nullopt;
+		}
+		co_return DecodeFrame(decrypt);
+	}
+
+	// file transfer
+
+	static constexpr size_t FileChunkSize = 64 * 1024;
+
+	// waits out EAGAIN on non-blocking sockets; true when the error was transient
+	bool Retry(bool writable) {
+		int err = _last_error();
+		if (SocketTraits::Interrupted(err)) {
+			return true;
+		}
+		if (SocketTraits::WouldBlock(err)) {
+			return writable ? sockbase::WaitWritable(-1) : sockbase::WaitReadable(-1);
+		}
+		return false;
+	}
+
+#ifdef _MSC_BUILD
+	bool SendFileChunks(std::ifstream& ifs, uint64_t left) {
+		auto chunk = std::make_unique_for_overwrite<char[]>(FileChunkSize);
+		while (left > 0) {
+			size_t size = static_cast<size_t>(std::min<uint64_t>(left, FileChunkSize));
+			if (!ifs.read(chunk.get(), size) || !WriteAll(chunk.get(), static_cast<int>(size))) {
+				return false;
+			}
+			left -= size;
+		}
+		return true;
+	}
+#else
+	bool SendFileRange(int fd, uint64_t left) {
+		off_t offset = 0;
+#ifdef __linux__
+		while (left > 0) {
+			size_t size = static_cast<size_t>(std::min<uint64_t>(left, 1u << 30));
+			ssize_t ret = Sent(static_cast<int>(sendfile(sockbase::sock(), fd, &offset, size)), size);
+			if (ret > 0) {
+				left -= ret;
+				continue;
+			}
+			if (ret == 0) {
+				// the file shrank after the header was sent
+				return false;
+			}
+			if (errno == EINVAL || errno == ENOSYS) {
+				// the file system can not feed sendfile; copy the rest through user space
+				break;
+			}
+			if (!Retry(true)) {
+				dbg_print();
+				return false;
+			}
+		}
+#endif // __linux__
+		auto chunk = std::make_unique_for_overwrite<SocketDetail::byte_t[]>(FileChunkSize);
+		while (left > 0) {
+			ssize_t ret = pread(fd, chunk.get(), static_cast<size_t>(std::min<uint64_t>(left, FileChunkSize)), offset);
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			}
+			if (ret <= 0 || !WriteAll(chunk.get(), static_cast<int>(ret))) {
+				return false;
+			}
+			offset += ret;
+			left -= ret;
+		}
+		return true;
+	}
+#endif // _MSC_BUILD
+
+#ifdef __linux__
+	// moves the payload socket -> pipe -> file inside the kernel. returns false when the connection failed;
+	// left > 0 on return with true means splice is unsupported here and the caller copies the rest
+	bool SpliceTo(int fd, uint64_t& left, bool& writable) {
+		int pipes[2];
+		if (left == 0 || pipe2(pipes, O_CLOEXEC) != 0) {
+			return true;
+		}
+		bool connected = true;
+		while (left > 0) {
+			ssize_t in = Received(static_cast<int>(splice(sockbase::sock(), nullptr, pipes[1], nullptr, static_cast<size_t>(std::min<uint64_t>(left, FileChunkSize)), SPLICE_F_MOVE | SPLICE_F_MORE)));
+			if (in == 0) {
+				connected = false;
+				break;
+			}
+			if (in < 0) {
+				if (errno == EINVAL) {
+					break;
+				}
+				if (!Retry(false)) {
+					connected = false;
+					break;
+				}
+				continue;
+			}
+			left -= in;
+			while (in > 0) {
+				ssize_t out = splice(pipes[0], nullptr, fd, nullptr, static_cast<size_t>(in), SPLICE_F_MOVE | SPLICE_F_MORE);
+				if (out < 0 && errno == EINTR) {
+					continue;
+				}
+				if (out <= 0) {
+					// the file failed; keep the stream in sync by discarding the bytes already in the pipe
+					writable = false;
+					SocketDetail::byte_t sink[4096];
+					while (in > 0) {
+						ssize_t n = read(pipes[0], sink, static_cast<size_t>(std::min<ssize_t>(in, sizeof(sink))));
+						if (n <= 0) {
+							break;
+						}
+						in -= n;
+					}
+					break;
+				}
+				in -= out;
+			}
+			if (!writable) {
+				break;
+			}
+		}
+		close(pipes[0]);
+		close(pipes[1]);
+		return connected;
+	}
+#endif // __linux__
+
+	template<class W>
+	bool RecvChunks(uint64_t left, W& write) {
+		auto chunk = std::make_unique_for_overwrite<SocketDetail::byte_t[]>(FileChunkSize);
+		while (left > 0) {
+			int ret = Received(sockbase::RecvSome(chunk.get(), static_cast<int>(std::min<uint64_t>(left, FileChunkSize))));
+			if (ret == 0) {
+				return false;
+			}
+			if (ret < 0) {
+				if (!Retry(false)) {
+					return false;
+				}
+				continue;
+			}
+			write(chunk.get(), static_cast<size_t>(ret));
+			left -= ret;
+		}
+		return true;
+	}
+
+	// socket must be non-blocking here; Connect restores the caller's mode afterwards
+	bool ConnectUntil(typename sockbase::IPType& hostaddr, int timeout) {
+		if (connect(sockbase::sock(), hostaddr, hostaddr.Length()) == 0) {
+			return true;
+		}
+		int err = _last_error();
+#ifdef _MSC_BUILD
+		if (err != WSAEWOULDBLOCK)
+#else
+		if (err != EINPROGRESS)
+#endif
+		{
+			dbg_print();
+			return false;
+		}
+		// a failed handshake also wakes the wait (POLLERR / POLLHUP); SO_ERROR tells which it was
+		if (sockbase::Wait(POLLOUT, timeout) <= 0) {
+			return false;
+		}
+		int error = 0;
+		socklen_t len = sizeof(int);
+		if (getsockopt(sockbase::sock(), SOL_SOCKET, SO_ERROR, (char*)&error, &len) != 0 || error != 0) {
+			return false;
+		}
+		return true;
+	}
+
+	// src must stay alive until the task completes; callers keep it in their own coroutine frame
+	Task<bool> AsyncRawSend(SocketDetail::byte_view src, EventLoop& loop) {
+		size_t sended = 0;
+		while (sended < src.size()) {
+			int ret = Sent(sockbase::SendSome(src.data() + sended, static_cast<int>(src.size() - sended), SocketTraits::DontWait), src.size() - sended);
+			if (ret > 0) {
+				sended += ret;
+				continue;
+			}
+			if (ret < 0 && SocketTraits::WouldBlock(_last_error())) {
+				auto ready = loop.Writable(sockbase::Handle());
+				if (!co_await ready) {
+					co_return false;
+				}
+				continue;
+			}
+			co_return false;
+		}
+		co_return true;
+	}
+
+	bool Crypt(AES128::byte_view src, AES128::byte_ref dest, typename AES128::cryptmode_t mode) {
+		if (!CryptEngine.IsInit()) {
+			return false;
+		}
+		return ((&CryptEngine)->*mode)(src, dest, src.size());
+	}
+	bool Encrypt(AES128::byte_view src, AES128::byte_ref dest) {
+		return m_metrics ? Timed(m_metrics->EncryptNanos, src, dest, &AES128::CTREncrypt) : Crypt(src, dest, &AES128::CTREncrypt);
+	}
+	bool Decrypt(AES128::byte_view src, AES128::byte_ref dest) {
+		return m_metrics ? Timed(m_metrics->DecryptNanos, src, dest, &AES128::CTRDecrypt) : Crypt(src, dest, &AES128::CTRDecrypt);
+	}
+	bool Timed(SocketMetrics::counter_t& counter, AES128::byte_view src, AES128::byte_ref dest, typename AES128::cryptmode_t mode) {
+		auto start = std::chrono::steady_clock::now();
+		bool ret = Crypt(src, dest, mode);
+		SocketMetrics::Add(counter, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+		return ret;
+	}
+
+	// metrics accounting of one send / recv call. both return ret untouched and leave errno alone
+	int Sent(int ret, size_t requested) {
+		if (m_metrics) {
+			m_metrics->Sent(ret, requested, ret < 0 && SocketTraits::WouldBlock(_last_error()));
+		}
+		return ret;
+	}
+	int Sent(int ret, const SocketDetail::byte_view* bufs, size_t count) {
+		if (m_metrics) {
+			size_t requested = 0;
+			for (size_t i = 0; i < std::min(count, SocketTraits::MaxVector); ++i) {
+				requested += bufs[i].size();
+			}
+			m_metrics->Sent(ret, requested, ret < 0 && SocketTraits::WouldBlock(_last_error()));
+		}
+		return ret;
+	}
+	int Received(int ret) {
+		if (m_metrics) {
+			m_metrics->Received(ret, ret < 0 && SocketTraits::WouldBlock(_last_error()));
+			if (ret > 0) {
+				m_arrival = std::chrono::steady_clock::now();
+			}
+		}
+		return ret;
+	}
+	bool SentPacket(bool ok) {
+		if (ok && m_metrics) {
+			SocketMetrics::Add(m_metrics->PacketsOut, 1);
+		}
+		return Pushed(ok);
+	}
+	// a corked socket holds the tail of a completed send back until something pushes it
+	bool Pushed(bool ok) {
+		if (ok && m_corked) {
+			Push();
+		}
+		return ok;
+	}
+
+	// blocking writes of the whole range that leave pushing to the caller
+	bool WriteAll(const void* src, int size) {
+		trace_scope("TCPSocket::RawSend", size);
+		int sended = 0;
+		while (sended < size) {
+			int ret = Sent(sockbase::SendSome(static_cast<const char*>(src) + sended, size - sended), size - sended);
+			if (ret <= 0) { return false; }
+			sended += ret;
+		}
+		return true;
+	}
+	bool WriteAllV(std::span<const SocketDetail::byte_view> bufs) {
+		std::array<SocketDetail::byte_view, SocketTraits::MaxVector> iov;
+		size_t next = 0;
+		size_t first = 0;
+		size_t count = 0;
+		while (true) {
+			if (first == count) {
+				first = count = 0;
+				for (; next < bufs.size() && count < iov.size(); ++next) {
+					if (!bufs[next].empty()) {
+						iov[count++] = bufs[next];
+					}
+				}
+				if (count == 0) {
+					return true;
+				}
+			}
+			int ret = Sent(sockbase::SendVector(iov.data() + first, count - first), iov.data() + first, count - first);
+			if (ret <= 0) { return false; }
+			size_t sended = static_cast<size_t>(ret);
+			while (sended > 0) {
+				if (sended >= iov[first].size()) {
+					sended -= iov[first].size();
+					++first;
+				}
+				else {
+					iov[first] = iov[first].subspan(sended);
+					sended = 0;
+				}
+			}
+		}
+	}
+
+	RecvBuffer m_recvbuf;
+	SendQueue m_sendqueue;
+	bool m_writewatch = false;
+	bool m_corked = false;
+
+	// buffers a MSG_ZEROCOPY send handed to the kernel, keyed by the send's notification id
+	struct ZeroCopyPin {
+		uint32_t id;
+		SendQueue::buffer_t frame;
+		bool done = false;
+	};
+	struct ZeroCopyState {
+		// 0 = off
+		size_t threshold = 0;
+		uint32_t next = 0;
+		std::deque<ZeroCopyPin> pins;
+		uint64_t sends = 0;
+		uint64_t copied = 0;
+		// notifications read off the error queue
+		uint64_t completions = 0;
+	} m_zerocopy;
+
+	std::shared_ptr<SocketMetrics> m_metrics;
+	// when the last recv returned, for RecvToDispatch
+	std::chrono::steady_clock::time_point m_arrival;
+
+};
+
+
+/// <summary>
+/// TCP Protocol Server
+/// </summary>
+
+template<class ipT, class sockbase = DefaultSocketBase<ipT, Protocol::TCP>>
+class basic_TCPServer : public sockbase {
+public:
+
+	using TCPSocket = basic_TCPSocket<ipT, sockbase>;
+
+	// accepted sockets inherit TCP_NODELAY from the listener
+	basic_TCPServer() : sockbase() {
+		if constexpr (sockbase::IPType::VersionValue != AF_UNIX) {
+			m_options.NoDelay = true;
+			SocketTraits::SetOption(sockbase::Handle(), IPPROTO_TCP, TCP_NODELAY, 1);
+		}
+	}
+	basic_TCPServer(uint16_t port) requires (sockbase::IPType::VersionValue != AF_UNIX) : basic_TCPServer() {
+		Listen(port);
+	}
+
+	basic_TCPServer(const basic_TCPServer&) = delete;
+	basic_TCPServer(basic_TCPServer&& other) noexcept : sockbase(std::move(other)), m_options(other.m_options), m_metrics(std::move(other.m_metrics)) {}
+
+	basic_TCPServer& operator=(const basic_TCPServer&) = delete;
+	basic_TCPServer& operator=(basic_TCPServer&& other) noexcept {
+		m_options = other.m_options;
+		m_metrics = std::move(other.m_metrics);
+		return *static_cast<basic_TCPServer*>(sockbase::Copy(&other));
+	}
+
+	/// <summary>
+	/// Applies the listener part of options now (call it before Bind / Listen for buffers, reuse and fast open)
+	/// and the connection part to every socket accepted from now on.
+	/// </summary>
+	bool Configure(const SocketOptions& options) {
+		m_options |= options;
+		return sockbase::Apply(options.ForListener());
+	}
+	const SocketOptions& Options() const {
+		return m_options;
+	}
+
+	/// <summary>
+	/// Counts every socket accepted from now on into group. servers may share one group,
+	/// e.g. the listeners of a sharded server.
+	/// </summary>
+	const MetricsGroup& EnableMetrics(MetricsGroup group = MetricsGroup()) {
+		m_metrics = std::move(group);
+		return *m_metrics;
+	}
+	// null until EnableMetrics
+	const MetricsGroup* Metrics() const {
+		return m_metrics ? std::addressof(*m_metrics) : nullptr;
+	}
+
+	bool Bind(typename sockbase::IPType addr) {
+#ifndef _MSC_BUILD
+		// before bind, or a port still in TIME_WAIT is refused. (on winsock SO_REUSEADDR would let others steal the port)
+		if (!m_options.ReuseAddr && sockbase::IPType::VersionValue != AF_UNIX) {
+			SocketTraits::SetOption(sockbase::sock(), SOL_SOCKET, SO_REUSEADDR, 1);
+		}
+#endif // _MSC_BUILD
+		if (bind(sockbase::sock(), addr, addr.Length()) < 0) {
+			dbg_print();
+			return false;
+		}
+		return true;
+	}
+	/// <summary>
+	/// Lets several listeners bind the same port; the kernel spreads new connections across them.
+	/// must be called before Bind / Listen. returns false where SO_REUSEPORT does not exist.
+	/// </summary>
+	bool ReusePort(bool flag = true) {
+#ifdef SO_REUSEPORT
+		int opt = flag ? 1 : 0;
+		if (setsockopt(sockbase::sock(), SOL_SOCKET, SO_REUSEPORT, (const char*)&opt, sizeof(int)) != 0) {
+			dbg_print();
+			return false;
+		}
+		return true;
+#else
+		return !flag;
+#endif // SO_REUSEPORT
+	}
+	bool Listen(uint16_t port, int backlog = 128) requires (sockbase::IPType::VersionValue != AF_UNIX) {
+		return Listen(typename sockbase::IPType(port), backlog);
+	}
+	// listens on addr, e.g. a UnixAddress path
+	bool Listen(typename sockbase::IPType addr, int backlog = 128) {
+		if (!this->Bind(addr)) {
+			return false;
+		}
+		if (listen(sockbase::sock(), backlog) != 0) {
+			dbg_print();
+			return false;
+		}
+		return true;
+	}
+	void StopListen() {
+		*this = basic_TCPServer();
+	}
+	/// <summary>
+	/// Accepts one connection, waiting up to timeout [ms] for it (0 = only if pending, -1 = infinite).
+	/// </summary>
+	std::optional<TCPSocket> Accept(int timeout = 0) {
+		int ret = sockbase::Poll(std::addressof(sockbase::pfd), 1, timeout);
+
+		if (!(ret > 0 && (sockbase::pfd.revents & POLLIN))) {
+			return std::nullopt;
+		}
+
+		TCPSocket client = sockbase::AcceptRaw();
+		if (!client.IsValid()) {
+			dbg_print();
+			return std::nullopt;
+		}
+		client.pfd.events = POLLIN;
+		client.Apply(m_options.ForConnection());
+		if (m_metrics) {
+			client.Metrics(m_metrics->Attach());
+		}
+		return client;
+	}
+	/// <summary>
+	/// Accepts every pending connection without polling.
+	/// meant to be called from an EventLoop Readable callback with the listener in non-blocking mode.
+	/// nonblocking hands the clients out ready for the event loop.
+	/// </summary>
+	template<class F>
+	size_t AcceptAll(F&& f, bool nonblocking = false) {
+		size_t count = 0;
+		while (true) {
+			// plain accept: the drain ends on EAGAIN from the non-blocking listener, which a ring accept would wait through
+			TCPSocket client = SocketBase<ipT, Protocol::TCP>::AcceptRaw(nonblocking);
+			if (!client.IsValid()) {
+				int err = _last_error();
+#ifdef _MSC_BUILD
+				if (err == WSAEINTR || err == WSAECONNRESET)
+#else
+				if (err == EINTR || err == ECONNABORTED)
+#endif
+				{
+					continue;
+				}
+				if (!SocketTraits::WouldBlock(err)) {
+					dbg_print();
+				}
+				break;
+			}
+			client.pfd.events = POLLIN;
+			client.Apply(m_options.ForConnection());
+			if (m_metrics) {
+				client.Metrics(m_metrics->Attach());
+			}
+			f(std::move(client));
+			++count;
+		}
+		return count;
+	}
+
+private:
+
+	// listener options are applied by Configure, the connection part on every accept
+	SocketOptions m_options;
+	std::optional<MetricsGroup> m_metrics;
+};
+
+
+/// <summary>
+/// TCP Protocol Sharded Server
+/// </summary>
+
+/// <summary>
+/// Listens on one port with a SO_REUSEPORT listener per worker thread. every worker runs its own EventLoop
+/// (the thread's EventLoop::Current()) and drains its accept queue there, so accepts scale across cores.
+/// clients are accepted non-blocking and handed to the callback on the worker that accepted them.
+/// </summary>
+template<class ipT, class sockbase = DefaultSocketBase<ipT, Protocol::TCP>>
+class basic_TCPShardedServer {
+public:
+
+	using TCPServer = basic_TCPServer<ipT, sockbase>;
+	using TCPSocket = typename TCPServer::TCPSocket;
+
+	// runs on the accepting worker; loop is that worker's event loop
+	using accept_t = std::function<void(TCPSocket&&, EventLoop&)>;
+
+	basic_TCPShardedServer() = default;
+	~basic_TCPShardedServer() {
+		Stop();
+	}
+
+	basic_TCPShardedServer(const basic_TCPShardedServer&) = delete;
+	basic_TCPShardedServer& operator=(const basic_TCPShardedServer&) = delete;
+
+	/// <summary>
+	/// Opens the listeners and starts the workers. workers = 0 uses one per hardware thread.
+	/// without SO_REUSEPORT only a single worker is started.
+	/// </summary>
+	bool Start(uint16_t port, accept_t onaccept, size_t workers = 0, int backlog = 1024) {
+		if (IsRunning() || !onaccept) {
+			return false;
+		}
+		if (workers == 0) {
+			workers = std::max(1u, std::thread::hardware_concurrency());
+		}
+		m_onaccept = std::move(onaccept);
+		for (size_t i = 0; i < workers; ++i) {
+			TCPServer listener;
+			if (!listener.ReusePort()) {
+				if (i == 0) {
+					workers = 1;
+				}
+				else {
+					break;
+				}
+			}
+			if (m_metrics) {
+				listener.EnableMetrics(*m_metrics);
+			}
+			if (!listener.Listen(port, backlog)) {
+				Stop();
+				return false;
+			}
+			listener._NonBlocking();
+			m_workers.push_back(std::make_unique<Worker>(std::move(listener)));
+		}
+		for (auto&& worker : m_workers) {
+			std::promise<EventLoop*> started;
+			auto loop = started.get_future();
+			worker->thread = std::thread([this, w = worker.get(), &started] { Run(*w, started); });
+			worker->loop = loop.get();
+		}
+		return true;
+	}
+	/// <summary>
+	/// Stops every worker and closes the listeners. clients already handed out are left alone.
+	/// </summary>
+	void Stop() {
+		for (auto&& worker : m_workers) {
+			if (worker->loop != nullptr) {
+				worker->loop->Stop();
+			}
+		}
+		for (auto&& worker : m_workers) {
+			if (worker->thread.joinable()) {
+				worker->thread.join();
+			}
+		}
+		m_workers.clear();
+	}
+
+	bool IsRunning() const {
+		return !m_workers.empty();
+	}
+	size_t Workers() const {
+		return m_workers.size();
+	}
+	// one group over every worker's clients. call before Start
+	const MetricsGroup& EnableMetrics(MetricsGroup group = MetricsGroup()) {
+		m_metrics = std::move(group);
+		return *m_metrics;
+	}
+	const MetricsGroup* Metrics() const {
+		return m_metrics ? std::addressof(*m_metrics) : nullptr;
+	}
+	/// <summary>
+	/// Event loop of worker i. only Stop() / Wakeup() may be called on it from other threads.
+	/// </summary>
+	EventLoop& Loop(size_t i) {
+		return *m_workers[i]->loop;
+	}
+
+private:
+
+	struct Worker {
+		TCPServer listener;
+		EventLoop* loop = nullptr;
+		std::thread thread;
+	};
+
+	void Run(Worker& worker, std::promise<EventLoop*>& started) {
+		EventLoop& loop = EventLoop::Current();
+		EventLoop::Handler handler;
+		handler.Readable = [&] {
+			worker.listener.AcceptAll([&](TCPSocket&& client) { m_onaccept(std::move(client), loop); }, true);
+		};
+		loop.Add(worker.listener, std::move(handler));
+		started.set_value(&loop);
+		loop.Run();
+		loop.Remove(worker.listener);
+	}
+
+	accept_t m_onaccept;
+	std::optional<MetricsGroup> m_metrics;
+	std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+
+/// <summary>
+/// Heartbeat Monitor
+/// </summary>
+
+/// <summary>
+/// Idle timeout and heartbeats for connections driven by one EventLoop. every tracked socket owns a single
+/// wheel timer, so tracking, touching and expiring are O(1) however many connections there are.
+/// call Touch() whenever something arrives from the peer. after each silent Interval a Beat is queued
+/// and flushed; after MaxMisses silent intervals in a row the peer is expired.
+/// tracked sockets must stay at the same address (e.g. map nodes) until they are untracked or expired.
+/// </summary>
+template<class socketT>
+class HeartbeatMonitor {
+public:
+	using sock_t = SocketTraits::sock_t;
+	using duration = TimerWheel::duration;
+
+	using expire_t = std::function<void(socketT&)>;
+
+	struct Options {
+		duration Interval = std::chrono::seconds(5);
+		// consecutive silent intervals before the peer is expired
+		size_t MaxMisses = 3;
+		// queued on every silent interval; an empty packet turns heartbeats off and keeps only the idle timeout
+		Packet Beat = DefaultBeat();
+	};
+
+	// the payload is a single byte because empty packets are not sendable
+	static Packet DefaultBeat() {
+		return Packet(Header::type_hash_code<HeartbeatMonitor>(), uint8_t(0));
+	}
+	static bool IsBeat(const Packet& pak) {
+		auto head = pak.GetHeader();
+		return head && head->Type == Header::type_hash_code<HeartbeatMonitor>();
+	}
+
+	explicit HeartbeatMonitor(EventLoop& loop, Options options = {}) : m_loop(loop), m_options(std::move(options)) {
+		m_options.Interval = std::max(m_options.Interval, m_loop.Timers().Tick());
+		m_options.MaxMisses = std::max<size_t>(m_options.MaxMisses, 1);
+	}
+	~HeartbeatMonitor() {
+		for (auto&& [_, entry] : m_entries) {
+			m_loop.Cancel(entry.timer);
+		}
+	}
+
+	HeartbeatMonitor(const HeartbeatMonitor&) = delete;
+	HeartbeatMonitor& operator=(const HeartbeatMonitor&) = delete;
+
+	bool Track(socketT& s) {
+		sock_t fd = s.Handle();
+		if (!s.IsValid() || m_entries.contains(fd)) {
+			return false;
+		}
+		Entry& entry = m_entries[fd];
+		entry.socket = &s;
+		entry.last = m_loop.Timers().Ticks();
+		entry.timer = Arm(fd, m_options.Interval);
+		return true;
+	}
+	bool Untrack(sock_t fd) {
+		auto it = m_entries.find(fd);
+		if (it == m_entries.end()) {
+			return false;
+		}
+		m_loop.Cancel(it->second.timer);
+		m_entries.erase(it);
+		return true;
+	}
+	bool Untrack(const socketT& s) {
+		return Untrack(s.Handle());
+	}
+
+	/// <summary>
+	/// Records activity from the peer. costs one hash lookup; the timer is left alone.
+	/// </summary>
+	void Touch(sock_t fd) {
+		auto it = m_entries.find(fd);
+		if (it != m_entries.end()) {
+			it->second.last = m_loop.Timers().Ticks();
+			it->second.misses = 0;
+		}
+	}
+	void Touch(const socketT& s) {
+		Touch(s.Handle());
+	}
+
+	bool Contains(sock_t fd) const {
+		return m_entries.contains(fd);
+	}
+	size_t Count() const {
+		return m_entries.size();
+	}
+
+	// called with the expired socket after it was untracked; remove it from the loop here. closes it when unset
+	expire_t OnExpire;
+
+private:
+
+	struct Entry {
+		socketT* socket = nullptr;
+		uint64_t last = 0;
+		size_t misses = 0;
+		TimerWheel::timer_t timer = 0;
+	};
+
+	TimerWheel::timer_t Arm(sock_t fd, duration delay) {
+		return m_loop.After(delay, [this, fd] { Check(fd); });
+	}
+
+	void Check(sock_t fd) {
+		auto it = m_entries.find(fd);
+		if (it == m_entries.end()) {
+			return;
+		}
+		Entry& entry = it->second;
+		TimerWheel& timers = m_loop.Timers();
+		duration idle = timers.Tick() * static_cast<duration::rep>(timers.Ticks() - entry.last);
+		if (idle < m_options.Interval) {
+			// the peer spoke during this interval; wait out the rest of it from its last activity
+			entry.timer = Arm(fd, m_options.Interval - idle);
+			return;
+		}
+		if (++entry.misses >= m_options.MaxMisses) {
+			socketT& s = *entry.socket;
+			m_entries.erase(it);
+			if (OnExpire) {
+				OnExpire(s);
+			}
+			else {
+				s.Close();
+			}
+			return;
+		}
+		if (!m_options.Beat.CheckHeader()) {
+			entry.socket->QueueSend(m_options.Beat);
+			entry.socket->Flush();
+		}
+		entry.timer = Arm(fd, m_options.Interval);
+	}
+
+	EventLoop& m_loop;
+	Options m_options;
+	std::unordered_map<sock_t, Entry> m_entries;
+};
+
+
+/// <summary>
+/// Connection Pool
+/// </summary>
+
+/// <summary>
+/// Keeps warm outbound connections per peer (address and port), so a request skips the handshake and key setup.
+/// a checkout reuses the most recently returned connection after a health check (LostConnection, no stray bytes)
+/// and otherwise connects lazily. Setup runs once per new connection, e.g. to Init the CryptEngine.
+/// thread-safe; the pool must outlive its leases.
+/// </summary>
+template<class ipT, class sockbase = DefaultSocketBase<ipT, Protocol::TCP>>
+class ConnectionPool {
+public:
+
+	using IPType = ipT;
+	using TCPSocket = basic_TCPSocket<ipT, sockbase>;
+	using clock_t = std::chrono::steady_clock;
+	// prepares a new connection; false discards it
+	using setup_t = std::function<bool(TCPSocket&)>;
+
+	struct Options {
+		// leased and idle connections to one peer
+		size_t MaxPerHost = 64;
+		size_t MaxIdlePerHost = 8;
+		size_t MaxIdle = 256;
+		std::chrono::milliseconds IdleTimeout = std::chrono::seconds(60);
+		// [ms] for Connect, 0 = blocking connect
+		int ConnectTimeout = 0;
+		// [ms] Acquire waits for a free slot at MaxPerHost (-1 = infinite, 0 = fail at once)
+		int WaitTimeout = -1;
+	};
+
+	/// <summary>
+	/// One checked out connection. returns to the pool on destruction unless Discard()ed or broken.
+	/// </summary>
+	class Lease {
+	public:
+		Lease() = default;
+		Lease(Lease&& other) noexcept : m_pool(std::exchange(other.m_pool, nullptr)), m_key(other.m_key), m_socket(std::move(other.m_socket)), m_reuse(other.m_reuse) {}
+		Lease& operator=(Lease&& other) noexcept {
+			if (this != &other) {
+				Release();
+				m_pool = std::exchange(other.m_pool, nullptr);
+				m_key = other.m_key;
+				m_socket = std::move(other.m_socket);
+				m_reuse = other.m_reuse;
+			}
+			return *this;
+		}
+		~Lease() {
+			Release();
+		}
+
+		explicit operator bool() const {
+			return m_pool != nullptr;
+		}
+		TCPSocket& operator*() {
+			return *m_socket;
+		}
+		TCPSocket* operator->() {
+			return std::addressof(*m_socket);
+		}
+		const IPType& Peer() const {
+			return m_key;
+		}
+		// closes the connection on release instead of keeping it warm, e.g. after a protocol error
+		void Discard() {
+			m_reuse = false;
+		}
+		void Release() {
+			if (m_pool != nullptr) {
+				std::exchange(m_pool, nullptr)->Checkin(m_key, std::move(*m_socket), m_reuse);
+				m_socket.reset();
+			}
+		}
+
+	private:
+		friend class ConnectionPool;
+		Lease(ConnectionPool* pool, const IPType& key, TCPSocket&& socket) : m_pool(pool), m_key(key), m_socket(std::move(socket)) {}
+
+		ConnectionPool* m_pool = nullptr;
+		IPType m_key;
+		std::optional<TCPSocket> m_socket;
+		bool m_reuse = true;
+	};
+
+	ConnectionPool() : ConnectionPool(Options{}) {}
+	explicit ConnectionPool(Options options, setup_t setup = nullptr) : m_options(options), m_setup(std::move(setup)) {}
+
+	ConnectionPool(const ConnectionPool&) = delete;
+	ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+	/// <summary>
+	/// Checks out a connection to addr. an empty lease means the connect or Setup failed, or no slot freed up in time.
+	/// </summary>
+	Lease Acquire(const IPType& addr) {
+		auto deadline = SocketTraits::Deadline(m_options.WaitTimeout);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		Host& host = m_hosts[addr];
+		while (true) {
+			while (!host.idle.empty()) {
+				Idle idle = std::move(host.idle.back());
+				host.idle.pop_back();
+				--m_idle;
+				++host.leased;
+				lock.unlock();
+				if (clock_t::now() - idle.since < m_options.IdleTimeout && Healthy(idle.socket)) {
+					return Lease(this, addr, std::move(idle.socket));
+				}
+				idle.socket.Close();
+				lock.lock();
+				--host.leased;
+			}
+			if (host.leased < m_options.MaxPerHost) {
+				break;
+			}
+			int remaining = SocketTraits::Remaining(deadline);
+			if (remaining < 0) {
+				m_cv.wait(lock);
+			}
+			else if (m_cv.wait_for(lock, std::chrono::milliseconds(remaining)) == std::cv_status::timeout &&
+				host.idle.empty() && host.leased >= m_options.MaxPerHost) {
+				return Lease();
+			}
+		}
+		++host.leased;
+		lock.unlock();
+
+		TCPSocket socket;
+		if (socket.Connect(addr, m_options.ConnectTimeout) && (!m_setup || m_setup(socket))) {
+			return Lease(this, addr, std::move(socket));
+		}
+		lock.lock();
+		--host.leased;
+		m_cv.notify_one();
+		return Lease();
+	}
+
+	/// <summary>
+	/// Closes idle connections past IdleTimeout. returns the number closed.
+	/// </summary>
+	size_t Prune() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto now = clock_t::now();
+		size_t ret = 0;
+		for (auto it = m_hosts.begin(); it != m_hosts.end();) {
+			ret += std::erase_if(it->second.idle, [&](const Idle& idle) { return now - idle.since >= m_options.IdleTimeout; });
+			if (it->second.idle.empty() && it->second.leased == 0) {
+				it = m_hosts.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+		m_idle -= ret;
+		return ret;
+	}
+	// closes every idle connection; leased ones are unaffected
+	void Clear() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto&& [addr, host] : m_hosts) {
+			host.idle.clear();
+		}
+		m_idle = 0;
+	}
+	size_t IdleCount() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_idle;
+	}
+	size_t LeasedCount(const IPType& addr) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_hosts.find(addr);
+		return it == m_hosts.end() ? 0 : it->second.leased;
+	}
+
+private:
+
+	struct Idle {
+		TCPSocket socket;
+		clock_t::time_point since;
+	};
+	struct Host {
+		std::deque<Idle> idle;
+		size_t leased = 0;
+	};
+
+	// a warm connection must still be up and must not hold unread bytes, which would be taken as the next reply
+	static bool Healthy(TCPSocket& socket) {
+		return socket.IsValid() && !socket.LostConnection() && socket.Available() == 0;
+	}
+
+	void Checkin(const IPType& addr, TCPSocket&& socket, bool reuse) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Host& host = m_hosts[addr];
+		--host.leased;
+		if (reuse && socket.IsValid() && host.idle.size() < m_options.MaxIdlePerHost && m_idle < m_options.MaxIdle) {
+			host.idle.push_back(Idle{std::move(socket), clock_t::now()});
+			++m_idle;
+		}
+		m_cv.notify_one();
+	}
+
+	Options m_options;
+	setup_t m_setup;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::unordered_map<IPType, Host, typename IPType::PortHash, typename IPType::PortEqual> m_hosts;
+	size_t m_idle = 0;
+};
+
+
+/// <summary>
+/// RPC Channel
+/// </summary>
+
+/// <summary>
+/// Many requests in flight on one connection. Call stamps a request id into the header (Header::RequestID)
+/// and routes the response carrying the same id to that call, in whatever order responses arrive.
+/// packets that are not responses go to the request handler, which answers with Reply.
+/// the receive side is driven by one of Start (a reader thread), Attach (an EventLoop) or Pump (the caller).
+/// callbacks run on that driver; AsyncCall is meant for Attach, where the loop thread resumes the coroutine.
+/// with Start, Call / Reply / Send may come from any thread: sends are serialised among themselves, and the
+/// reader thread only receives (its connection check takes the send lock). the socket itself must not be
+/// used through Socket() meanwhile. with Attach, every call must come from the loop thread (EventLoop::Post).
+/// </summary>
+template<class socketT>
+class RpcChannel {
+public:
+
+	using TCPSocket = socketT;
+	using reply_t = std::optional<Packet>;
+	using callback_t = std::function<void(reply_t)>;
+	using request_t = std::function<void(Packet&&)>;
+
+	struct Options {
+		// EncryptionSend / EncryptionRecv with the socket's CryptEngine
+		bool Encrypted = false;
+		// [ms] the reader thread re-checks Close() this often
+		int PollInterval = 100;
+	};
+
+	explicit RpcChannel(TCPSocket&& socket, request_t onrequest = nullptr, Options options = {}) :
+		m_socket(std::move(socket)), m_onrequest(std::move(onrequest)), m_options(options) {}
+	~RpcChannel() {
+		Close();
+	}
+
+	RpcChannel(const RpcChannel&) = delete;
+	RpcChannel& operator=(const RpcChannel&) = delete;
+
+	TCPSocket& Socket() {
+		return m_socket;
+	}
+	size_t Pending() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_pending.size();
+	}
+
+	/// <summary>
+	/// Sends request and calls f with the response, or with nullopt when the connection is lost first.
+	/// returns the request id, or 0 when the request could not be sent (f is not called).
+	/// </summary>
+	uint32_t Call(Packet request, callback_t f) {
+		auto head = request.GetHeader();
+		if (!head) {
+			return 0;
+		}
+		uint32_t id = NextID();
+		request.SetHeader(head->RequestID(id).Response(false));
+		{
+			// registered before sending: the response may be routed before Send returns
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.emplace(id, std::move(f));
+		}
+		if (!Send(request)) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// the entry is gone when the connection failed meanwhile: FailAll has already called f
+			if (m_pending.erase(id) != 0) {
+				return 0;
+			}
+		}
+		return id;
+	}
+	std::future<reply_t> Call(Packet request) {
+		auto promise = std::make_shared<std::promise<reply_t>>();
+		std::future<reply_t> ret = promise->get_future();
+		if (Call(std::move(request), [promise](reply_t reply) { promise->set_value(std::move(reply)); }) == 0) {
+			promise->set_value(std::nullopt);
+		}
+		return ret;
+	}
+
+	struct CallAwaiter {
+		RpcChannel& channel;
+		Packet request;
+		reply_t result{};
+
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> h) {
+			return channel.Call(std::move(request), [this, h](reply_t reply) {
+				result = std::move(reply);
+				h.resume();
+			}) != 0;
+		}
+		reply_t await_resume() {
+			return std::move(result);
+		}
+	};
+
+	Task<reply_t> AsyncCall(Packet request) {
+		CallAwaiter awaiter{*this, std::move(request)};
+		co_return co_await awaiter;
+	}
+
+	/// <summary>
+	/// Answers the request whose header is given; the response carries its request id.
+	/// </summary>
+	bool Reply(const Header& request, Packet response) {
+		auto head = response.GetHeader();
+		if (!head || request.RequestID() == 0) {
+			return false;
+		}
+		response.SetHeader(head->RequestID(request.RequestID()).Response());
+		return Send(response);
+	}
+	// one-way packet, delivered to the peer's request handler. attached channels queue it and flush without blocking
+	bool Send(const Packet& src) {
+		std::lock_guard<std::mutex> lock(m_sendmutex);
+		if (m_loop != nullptr) {
+			if (src.CheckHeader() || (m_options.Encrypted && !m_socket.CryptEngine.IsInit())) {
+				return false;
+			}
+			// false from the queue is only backpressure: the frame is queued all the same
+			m_options.Encrypted ? m_socket.QueueEncryptionSend(src) : m_socket.QueueSend(src);
+			return m_socket.Flush(*m_loop);
+		}
+		return m_options.Encrypted ? m_socket.EncryptionSend(src) : m_socket.Send(src);
+	}
+
+	/// <summary>
+	/// Starts a reader thread that routes every incoming packet until Close() or the connection is lost.
+	/// </summary>
+	bool Start() {
+		if (m_reader.joinable() || m_loop != nullptr || !m_socket.IsValid()) {
+			return false;
+		}
+		m_stop = false;
+		m_reader = std::thread([this]() {
+			while (!m_stop) {
+				if (Pump(m_options.PollInterval) < 0) {
+					break;
+				}
+			}
+		});
+		return true;
+	}
+	/// <summary>
+	/// Routes incoming packets from loop's thread. the socket is switched to non-blocking mode,
+	/// and outgoing packets go through its send queue, flushed whenever the socket turns writable.
+	/// </summary>
+	bool Attach(EventLoop& loop) {
+		if (m_reader.joinable() || m_loop != nullptr || !m_socket.IsValid()) {
+			return false;
+		}
+		SocketTraits::NonBlocking(m_socket.Handle());
+		EventLoop::Handler handler;
+		handler.Readable = [this]() {
+			auto route = [this](Packet&& pak) { Route(std::move(pak)); };
+			// the peer closed, the connection failed or a response did not decrypt: either way no reply is coming
+			if ((m_options.Encrypted ? m_socket.EncryptionRecvAll(route) : m_socket.RecvAll(route)) < 0) {
+				Detach();
+				FailAll();
+			}
+		};
+		handler.Writable = [this]() {
+			bool flushed;
+			{
+				std::lock_guard<std::mutex> lock(m_sendmutex);
+				flushed = m_loop == nullptr || m_socket.Flush(*m_loop);
+			}
+			if (!flushed) {
+				Detach();
+				FailAll();
+			}
+		};
+		handler.Error = [this]() {
+			std::lock_guard<std::mutex> lock(m_sendmutex);
+			return m_socket.PollError();
+		};
+		handler.Hangup = [this]() {
+			Detach();
+			FailAll();
+		};
+		if (!loop.Add(m_socket, std::move(handler))) {
+			return false;
+		}
+		m_loop = &loop;
+		return true;
+	}
+	/// <summary>
+	/// Waits up to timeout [ms] for one packet and routes it. returns 1 when a packet was routed,
+	/// 0 on timeout, and -1 once the connection is lost (pending calls then fail).
+	/// </summary>
+	int Pump(int timeout) {
+		reply_t pak = m_options.Encrypted ? m_socket.EncryptionRecv(timeout) : m_socket.Recv(timeout);
+		if (pak) {
+			Route(std::move(*pak));
+			return 1;
+		}
+		if (!m_socket.IsValid() || Lost()) {
+			FailAll();
 			return -1;
 		}
-		return bytes;
-#endif
+		return 0;
 	}
-	std::optional<typename sockbase::IPType> GetPeerAddress() {
-		typename sockbase::IPType ret;
-		socklen_t addrlen = sizeof(ret);
-		if (getpeername(sockbase::sock(), static_cast<sockaddr*>(ret), &addrlen) != 0) {
-			return std::nullopt;
+
+	/// <summary>
+	/// Stops the driver, closes the socket and fails every pending call.
+	/// </summary>
+	void Close() {
+		m_stop = true;
+		if (m_reader.joinable()) {
+			m_reader.join();
+		}
+		Detach();
+		m_socket.Close();
+		FailAll();
+	}
+
+private:
+
+	uint32_t NextID() {
+		uint32_t id;
+		do {
+			id = m_nextid.fetch_add(1, std::memory_order_relaxed);
+		} while (id == 0);
+		return id;
+	}
+
+	void Route(Packet&& pak) {
+		auto head = pak.GetHeader();
+		if (!head) {
+			return;
+		}
+		if (!head->IsResponse()) {
+			if (m_onrequest) {
+				m_onrequest(std::move(pak));
+			}
+			return;
+		}
+		callback_t f;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_pending.find(head->RequestID());
+			if (it == m_pending.end()) {
+				// a response nobody waits for (e.g. to a call that already failed)
+				return;
+			}
+			f = std::move(it->second);
+			m_pending.erase(it);
+		}
+		f(std::move(pak));
+	}
+	// LostConnection reaps zero copy completions, which belong to the send side
+	bool Lost() {
+		std::lock_guard<std::mutex> lock(m_sendmutex);
+		return m_socket.LostConnection();
+	}
+	void FailAll() {
+		std::unordered_map<uint32_t, callback_t> pending;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			pending.swap(m_pending);
+		}
+		for (auto&& [_, f] : pending) {
+			f(std::nullopt);
+		}
+	}
+	void Detach() {
+		if (m_loop != nullptr) {
+			std::exchange(m_loop, nullptr)->Remove(m_socket.Handle());
+		}
+	}
+
+	TCPSocket m_socket;
+	request_t m_onrequest;
+	Options m_options;
+	mutable std::mutex m_mutex;
+	std::mutex m_sendmutex;
+	std::unordered_map<uint32_t, callback_t> m_pending;
+	std::atomic<uint32_t> m_nextid = 1;
+	std::atomic<bool> m_stop = false;
+	std::thread m_reader;
+	EventLoop* m_loop = nullptr;
+};
+
+
+/// <summary>
+/// Broadcast Hub
+/// </summary>
+
+/// <summary>
+/// Topics with subscriber sets. Publish builds the frame once (and encrypts it once with the topic's group key),
+/// then queues the same reference-counted buffer on every subscriber's SendQueue and flushes without blocking,
+/// so fan-out costs no per-recipient copy or cipher pass. PerSubscriber topics fall back to one
+/// QueueEncryptionSend per subscriber for peers that do not share a key.
+/// not thread-safe; subscribers must stay at the same address until they are unsubscribed.
+/// </summary>
+template<class socketT>
+class BroadcastHub {
+public:
+
+	using bytearray = SocketDetail::bytearray;
+
+	enum class Mode {
+		// the frame goes out as is
+		Plain,
+		// the payload is encrypted once with the topic key, which every subscriber's CryptEngine shares
+		GroupKey,
+		// encrypted per subscriber with its own CryptEngine
+		PerSubscriber,
+	};
+
+	struct Options {
+		// subscribers whose queue is over its high watermark miss the message instead of growing further
+		bool SkipBackpressured = false;
+	};
+
+	BroadcastHub() = default;
+	explicit BroadcastHub(Options options) : m_options(options) {}
+
+	BroadcastHub(const BroadcastHub&) = delete;
+	BroadcastHub& operator=(const BroadcastHub&) = delete;
+
+	/// <summary>
+	/// Creates or reconfigures a topic. a GroupKey topic is made by the overload taking its key.
+	/// </summary>
+	bool Topic(const std::string& topic, Mode mode = Mode::Plain) {
+		if (mode == Mode::GroupKey) {
+			return false;
+		}
+		m_topics[topic].mode = mode;
+		return true;
+	}
+	template<class K>
+	bool Topic(const std::string& topic, const K& key) requires requires(AES128& engine) { engine.Init(key); } {
+		Group& group = m_topics[topic];
+		if (!group.engine.Init(key)) {
+			return false;
+		}
+		group.mode = Mode::GroupKey;
+		return true;
+	}
+	bool RemoveTopic(const std::string& topic) {
+		return m_topics.erase(topic) != 0;
+	}
+
+	// subscribing to an unknown topic creates it as Plain
+	bool Subscribe(const std::string& topic, socketT& s) {
+		Group& group = m_topics[topic];
+		if (!s.IsValid() || group.index.contains(&s)) {
+			return false;
+		}
+		group.index.emplace(&s, group.members.size());
+		group.members.push_back(&s);
+		return true;
+	}
+	bool Unsubscribe(const std::string& topic, socketT& s) {
+		auto it = m_topics.find(topic);
+		return it != m_topics.end() && Erase(it->second, &s);
+	}
+	// drops s from every topic, e.g. when its connection is lost
+	size_t UnsubscribeAll(socketT& s) {
+		size_t ret = 0;
+		for (auto&& [_, group] : m_topics) {
+			ret += Erase(group, &s) ? 1 : 0;
 		}
 		return ret;
 	}
-	bool LostConnection() {
-		int ret = sockbase::Poll(std::addressof(sockbase::pfd), 1, 0);
+	size_t Subscribers(const std::string& topic) const {
+		auto it = m_topics.find(topic);
+		return it == m_topics.end() ? 0 : it->second.members.size();
+	}
 
-		if (ret == 0) {
+	/// <summary>
+	/// Sends src to every subscriber of topic except except. returns the number of subscribers it was queued for.
+	/// frames a subscriber could not take yet stay queued for its next Flush.
+	/// </summary>
+	size_t Publish(const std::string& topic, const Packet& src, const socketT* except = nullptr) {
+		auto it = m_topics.find(topic);
+		if (it == m_topics.end() || src.CheckHeader()) {
+			return 0;
+		}
+		Group& group = it->second;
+		if (group.mode == Mode::PerSubscriber) {
+			return FanOut(group, except, [&](socketT& s) { return s.QueueEncryptionSend(src); });
+		}
+		auto frame = std::make_shared<bytearray>(src.GetBuffer());
+		if (group.mode == Mode::GroupKey) {
+			SocketDetail::byte_ref payload = SocketDetail::byte_ref(*frame).subspan(Packet::HeaderSize);
+			if (!group.engine.CTREncrypt(payload, payload, payload.size())) {
+				return 0;
+			}
+		}
+		SendQueue::buffer_t shared = std::move(frame);
+		return FanOut(group, except, [&](socketT& s) { return s.QueueSend(shared); });
+	}
+
+private:
+
+	struct Group {
+		Mode mode = Mode::Plain;
+		AES128 engine;
+		std::vector<socketT*> members;
+		std::unordered_map<const socketT*, size_t> index;
+	};
+
+	static bool Erase(Group& group, const socketT* s) {
+		auto it = group.index.find(s);
+		if (it == group.index.end()) {
+			return false;
+		}
+		size_t i = it->second;
+		group.index.erase(it);
+		if (i + 1 != group.members.size()) {
+			group.members[i] = group.members.back();
+			group.index[group.members[i]] = i;
+		}
+		group.members.pop_back();
+		return true;
+	}
+
+	template<class F>
+	size_t FanOut(Group& group, const socketT* except, F&& queue) {
+		size_t ret = 0;
+		for (socketT* s : group.members) {
+			if (s == except || (m_options.SkipBackpressured && s->OutboundQueue().IsBackpressured())) {
+				continue;
+			}
+			queue(*s);
+			s->Flush();
+			++ret;
+		}
+		return ret;
+	}
+
+	Options m_options;
+	std::unordered_map<std::string, Group> m_topics;
+};
+
+
+/// <summary>
+/// UDP Protocol Socket
+/// </summary>
+
+/// <summary>
+/// Datagram socket. every datagram carries one packet (header and payload), so there is no stream framing.
+/// the batch API moves up to BatchSize datagrams per system call (sendmmsg / recvmmsg on linux),
+/// and with GSO enabled hands runs of equally sized packets to the kernel as one segmented send.
+/// </summary>
+template<class ipT, class sockbase = DefaultSocketBase<ipT, Protocol::UDP>>
+class basic_UDPSocket : public sockbase {
+public:
+
+	using bytearray = typename sockbase::bytearray;
+	using IPType = typename sockbase::IPType;
+
+	// largest udp payload of one datagram
+	static constexpr size_t MaxDatagramSize = ipT::IsIPv4 ? 65507 : 65527;
+	// upper bound of datagrams moved by one batch call
+	static constexpr size_t BatchSize = 64;
+	// receive slot of the batch API. datagrams larger than a slot are dropped by RecvBatch
+	static constexpr size_t DefaultSlotSize = 2048;
+
+	basic_UDPSocket() : sockbase() {}
+	basic_UDPSocket(uint16_t port) : basic_UDPSocket() {
+		Bind(IPType(port));
+	}
+
+	basic_UDPSocket(const basic_UDPSocket&) = delete;
+	basic_UDPSocket(basic_UDPSocket&& other) noexcept : sockbase(std::move(other)), m_storage(std::move(other.m_storage)), m_storagesize(std::exchange(other.m_storagesize, 0)), m_slotsize(other.m_slotsize), m_gso(other.m_gso), m_gro(other.m_gro) {}
+
+	basic_UDPSocket& operator=(const basic_UDPSocket&) = delete;
+	basic_UDPSocket& operator=(basic_UDPSocket&& other) noexcept {
+		m_storage = std::move(other.m_storage);
+		m_storagesize = std::exchange(other.m_storagesize, 0);
+		m_slotsize = other.m_slotsize;
+		m_gso = other.m_gso;
+		m_gro = other.m_gro;
+		sockbase::operator=(std::move(other));
+		return *this;
+	}
+
+	bool Bind(IPType addr) {
+		if (bind(sockbase::sock(), addr, sizeof(IPType)) < 0) {
+			dbg_print();
+			return false;
+		}
+		return true;
+	}
+	/// <summary>
+	/// Fixes the peer. Send / SendBatch without an address go there and only its datagrams are received.
+	/// </summary>
+	bool Connect(IPType addr) {
+		if (connect(sockbase::sock(), addr, sizeof(IPType)) < 0) {
+			dbg_print();
 			return false;
 		}
+		return true;
+	}
+
+	std::optional<IPType> GetLocalAddress() {
+		IPType ret;
+		socklen_t len = sizeof(IPType);
+		if (getsockname(sockbase::sock(), ret, &len) != 0) {
+			dbg_print();
+			return std::nullopt;
+		}
+		return ret;
+	}
 
+	bool Send(const Packet& src) {
+		if (!Sendable(src)) {
+			return false;
+		}
+		const bytearray& buf = src.GetBuffer();
+		return sockbase::SendSome(buf.data(), static_cast<int>(buf.size())) == static_cast<int>(buf.size());
+	}
+	bool SendTo(const Packet& src, IPType addr) {
+		if (!Sendable(src)) {
+			return false;
+		}
+		const bytearray& buf = src.GetBuffer();
+		int ret = sendto(sockbase::sock(), reinterpret_cast<const char*>(buf.data()), static_cast<int>(buf.size()), 0, addr, sizeof(IPType));
+		if (ret != static_cast<int>(buf.size())) {
+			dbg_print();
+			return false;
+		}
+		return true;
+	}
+	/// <summary>
+	/// Receives one datagram. datagrams that do not hold a whole packet are discarded.
+	/// a GRO coalesced datagram yields only its first packet here, use RecvBatch / RecvAll with GRO.
+	/// </summary>
+	std::optional<Packet> Recv() {
+		int ret = sockbase::RecvSome(Storage(MaxDatagramSize), static_cast<int>(MaxDatagramSize));
 		if (ret < 0) {
 			dbg_print();
-			int err = _last_error();
-#ifdef _MSC_BUILD
-			if (err == WSAEINTR)
+			return std::nullopt;
+		}
+		return First(static_cast<size_t>(ret));
+	}
+	std::optional<Packet> Recv(int timeout) {
+		if (!sockbase::WaitReadable(timeout)) {
+			return std::nullopt;
+		}
+		return Recv();
+	}
+	std::optional<Packet> RecvFrom(IPType& from) {
+		socklen_t len = sizeof(IPType);
+		int ret = recvfrom(sockbase::sock(), reinterpret_cast<char*>(Storage(MaxDatagramSize)), static_cast<int>(MaxDatagramSize), 0, from, &len);
+		if (ret < 0) {
+			dbg_print();
+			return std::nullopt;
+		}
+		return First(static_cast<size_t>(ret));
+	}
+
+	// Batch API. the socket should be _NonBlocking() on platforms without MSG_DONTWAIT.
+
+	/// <summary>
+	/// Sends packets to addr with as few system calls as possible.
+	/// returns how many packets from the front were sent (stops at an invalid packet or a full send buffer),
+	/// or -1 when the first send failed.
+	/// </summary>
+	int SendBatch(std::span<const Packet> packets, IPType addr) {
+		return SendPackets(packets, addr, sizeof(IPType));
+	}
+	int SendBatch(std::span<const Packet> packets) {
+		return SendPackets(packets, nullptr, 0);
+	}
+	/// <summary>
+	/// One batched receive without blocking. f is called as f(Packet&&, const IPType& from).
+	/// returns the number of packets delivered, 0 when nothing was pending, -1 on error.
+	/// </summary>
+	template<class F>
+	int RecvBatch(F&& f) {
+		size_t slot = SlotSize();
+		size_t count = m_gro ? GROBatchSize : BatchSize;
+		SocketDetail::byte_t* storage = Storage(slot * count);
+		std::array<IPType, BatchSize> from;
+		int delivered = 0;
+#if defined(__linux__)
+		std::array<struct mmsghdr, BatchSize> msgs{};
+		std::array<struct iovec, BatchSize> iov;
+		for (size_t i = 0; i < count; ++i) {
+			iov[i].iov_base = storage + slot * i;
+			iov[i].iov_len = slot;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = static_cast<struct sockaddr*>(from[i]);
+			msgs[i].msg_hdr.msg_namelen = sizeof(IPType);
+		}
+		int ret = recvmmsg(sockbase::sock(), msgs.data(), static_cast<unsigned int>(count), MSG_DONTWAIT, nullptr);
+		if (ret < 0) {
+			return SocketTraits::WouldBlock(_last_error()) ? 0 : -1;
+		}
+		for (int i = 0; i < ret; ++i) {
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				continue;
+			}
+			delivered += static_cast<int>(Split(SocketDetail::byte_view(storage + slot * i, msgs[i].msg_len), from[i], f));
+		}
 #else
-			if (err == EINTR)
-#endif
-			{
-				return false;
+		for (size_t i = 0; i < count; ++i) {
+			socklen_t len = sizeof(IPType);
+			int ret = recvfrom(sockbase::sock(), reinterpret_cast<char*>(storage), static_cast<int>(slot), SocketTraits::DontWait, from[0], &len);
+			if (ret < 0) {
+				if (i == 0 && !SocketTraits::WouldBlock(_last_error())) {
+					return -1;
+				}
+				break;
 			}
-			return true;
+			delivered += static_cast<int>(Split(SocketDetail::byte_view(storage, static_cast<size_t>(ret)), from[0], f));
+		}
+#endif // __linux__
+		return delivered;
+	}
+	/// <summary>
+	/// Repeats RecvBatch until the kernel has nothing left. meant to be called from an EventLoop Readable callback.
+	/// </summary>
+	template<class F>
+	size_t RecvAll(F&& f) {
+		size_t count = 0;
+		while (true) {
+			int ret = RecvBatch(f);
+			if (ret <= 0) {
+				break;
+			}
+			count += static_cast<size_t>(ret);
 		}
+		return count;
+	}
 
-		if (sockbase::pfd.revents & (POLLHUP | POLLERR)) {
-			return true;
+	/// <summary>
+	/// Receive slot size of the batch API. pick the largest datagram expected.
+	/// </summary>
+	basic_UDPSocket& SlotSize(size_t size) {
+		m_slotsize = std::clamp<size_t>(size, Packet::HeaderSize, MaxDatagramSize);
+		return *this;
+	}
+	size_t SlotSize() const {
+		return m_gro ? MaxDatagramSize : m_slotsize;
+	}
+
+	/// <summary>
+	/// UDP generic segmentation offload for SendBatch. linux only; returns false where unsupported.
+	/// turned off again automatically when the route rejects segmented sends.
+	/// </summary>
+	bool EnableGSO(bool flag = true) {
+#ifdef UDP_SEGMENT
+		m_gso = flag;
+		return true;
+#else
+		m_gso = false;
+		return !flag;
+#endif // UDP_SEGMENT
+	}
+	/// <summary>
+	/// UDP generic receive offload. coalesced datagrams are split back into packets by RecvBatch.
+	/// </summary>
+	bool EnableGRO(bool flag = true) {
+#ifdef UDP_GRO
+		int opt = flag ? 1 : 0;
+		if (setsockopt(sockbase::sock(), IPPROTO_UDP, UDP_GRO, &opt, sizeof(int)) != 0) {
+			dbg_print();
+			return false;
+		}
+		m_gro = flag;
+		return true;
+#else
+		return !flag;
+#endif // UDP_GRO
+	}
+
+protected:
+
+	// a coalesced datagram can be as large as MaxDatagramSize, so fewer slots are used with GRO
+	static constexpr size_t GROBatchSize = 16;
+
+	static bool Sendable(const Packet& src) {
+		return !src.CheckHeader() && src.Size() <= MaxDatagramSize;
+	}
+
+	SocketDetail::byte_t* Storage(size_t size) {
+		if (m_storagesize < size) {
+			m_storage = std::make_unique_for_overwrite<SocketDetail::byte_t[]>(size);
+			m_storagesize = size;
 		}
+		return m_storage.get();
+	}
 
-		if (sockbase::pfd.revents & POLLIN) {
-			char buf;
-			int r = recv(sockbase::sock(), &buf, 1, MSG_PEEK);
-			if (r == 0) {
-				return true;
+	/// <summary>
+	/// Hands every whole packet in one datagram to f. GRO stacks several segments (one packet each) into a datagram.
+	/// </summary>
+	template<class F>
+	static size_t Split(SocketDetail::byte_view data, const IPType& from, F&& f) {
+		size_t count = 0;
+		while (data.size() >= Packet::HeaderSize) {
+			Header head;
+			std::memcpy(&head, data.data(), Packet::HeaderSize);
+			size_t framesize = Packet::HeaderSize + head.Size;
+			if (framesize > data.size()) {
+				break;
 			}
-			if (r < 0) {
+			Packet pak;
+			pak.SetBuffer(bytearray(data.begin(), data.begin() + framesize));
+			f(std::move(pak), from);
+			data = data.subspan(framesize);
+			++count;
+		}
+		return count;
+	}
+	std::optional<Packet> First(size_t size) {
+		std::optional<Packet> ret;
+		Split(SocketDetail::byte_view(m_storage.get(), size), IPType(), [&](Packet&& pak, const IPType&) {
+			if (!ret) {
+				ret = std::move(pak);
+			}
+		});
+		return ret;
+	}
+
+	int SendPackets(std::span<const Packet> packets, struct sockaddr* addr, socklen_t addrlen) {
+		size_t sent = 0;
+#if defined(__linux__)
+		std::array<struct mmsghdr, BatchSize> msgs;
+		std::array<struct iovec, BatchSize> iov;
+		std::array<size_t, BatchSize> runs;
+#ifdef UDP_SEGMENT
+		struct control_t {
+			alignas(struct cmsghdr) char data[CMSG_SPACE(sizeof(uint16_t))];
+		};
+		std::array<control_t, BatchSize> control;
+#endif // UDP_SEGMENT
+		while (sent < packets.size()) {
+			size_t count = 0;
+			size_t used = 0;
+			while (used < BatchSize && sent + used < packets.size()) {
+				size_t run = Run(packets.subspan(sent + used), BatchSize - used);
+				if (run == 0) {
+					break;
+				}
+				struct msghdr& hdr = msgs[count].msg_hdr;
+				hdr = {};
+				hdr.msg_name = addr;
+				hdr.msg_namelen = addrlen;
+				hdr.msg_iov = &iov[used];
+				hdr.msg_iovlen = run;
+				for (size_t i = 0; i < run; ++i) {
+					const bytearray& buf = packets[sent + used + i].GetBuffer();
+					iov[used + i].iov_base = const_cast<SocketDetail::byte_t*>(buf.data());
+					iov[used + i].iov_len = buf.size();
+				}
+#ifdef UDP_SEGMENT
+				if (run > 1) {
+					hdr.msg_control = control[count].data;
+					hdr.msg_controllen = sizeof(control_t);
+					struct cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+					cm->cmsg_level = SOL_UDP;
+					cm->cmsg_type = UDP_SEGMENT;
+					cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+					uint16_t segment = static_cast<uint16_t>(packets[sent + used].Size());
+					std::memcpy(CMSG_DATA(cm), &segment, sizeof(uint16_t));
+				}
+#endif // UDP_SEGMENT
+				runs[count++] = run;
+				used += run;
+			}
+			if (count == 0) {
+				break;
+			}
+			int ret = sendmmsg(sockbase::sock(), msgs.data(), static_cast<unsigned int>(count), MSG_DONTWAIT);
+			if (ret < 0) {
 				int err = _last_error();
-#ifdef _MSC_BUILD
-				if (err == WSAECONNRESET)
+				if (m_gso && (err == EIO || err == EINVAL || err == ENOPROTOOPT)) {
+					// the route or device can not segment; resend the same packets one datagram each
+					m_gso = false;
+					continue;
+				}
+				if (sent == 0 && !SocketTraits::WouldBlock(err)) {
+					dbg_print();
+					return -1;
+				}
+				break;
+			}
+			for (int i = 0; i < ret; ++i) {
+				sent += runs[i];
+			}
+			if (static_cast<size_t>(ret) < count) {
+				break;
+			}
+		}
 #else
-				if (err == ECONNRESET)
-#endif
-				{
-					return true;
+		for (; sent < packets.size(); ++sent) {
+			if (!Sendable(packets[sent])) {
+				break;
+			}
+			const bytearray& buf = packets[sent].GetBuffer();
+			int ret = addr
+				? sendto(sockbase::sock(), reinterpret_cast<const char*>(buf.data()), static_cast<int>(buf.size()), SocketTraits::DontWait, addr, addrlen)
+				: sockbase::SendSome(buf.data(), static_cast<int>(buf.size()), SocketTraits::DontWait);
+			if (ret < 0) {
+				if (sent == 0 && !SocketTraits::WouldBlock(_last_error())) {
+					dbg_print();
+					return -1;
 				}
+				break;
 			}
 		}
-
-		return false;
+#endif // __linux__
+		return static_cast<int>(sent);
 	}
-	void _NonBlocking() {
-#ifdef _MSC_BUILD
-		u_long mode = 1;
-		ioctlsocket(sockbase::sock(), FIONBIO, &mode);
-#else
-		int flag = fcntl(sockbase::sock(), F_GETFL, 0);
-		fcntl(sockbase::sock(), F_SETFL, flag | O_NONBLOCK);
-#endif
+	int SendPackets(std::span<const Packet> packets, IPType& addr, socklen_t addrlen) {
+		return SendPackets(packets, static_cast<struct sockaddr*>(addr), addrlen);
 	}
 
-	bool RawSend(const void* src, int size) {
-		int sended = 0;
-		while (sended < size) {
-			int ret = send(sockbase::sock(), static_cast<const char*>(src) + sended, size - sended, 0);
-			if (ret <= 0) { return false; }
-			sended += ret;
+	/// <summary>
+	/// Number of packets from the front that go out as one datagram: 1 without GSO, otherwise the run
+	/// of equally sized packets (the last one may be shorter) that fits into one segmented send. 0 for an invalid packet.
+	/// </summary>
+	size_t Run(std::span<const Packet> packets, size_t max) const {
+		if (packets.empty() || !Sendable(packets[0])) {
+			return 0;
 		}
-		return true;
-	}
-	bool RawRecv(void* dest, int size) {
-		int received = 0;
-		while (received < size) {
-			int ret = recv(sockbase::sock(), static_cast<char*>(dest) + received, size - received, 0);
-			if (ret <= 0) { return false; }
-			received += ret;
+		if (!m_gso) {
+			return 1;
 		}
-		return true;
+		size_t segment = packets[0].Size();
+		size_t total = segment;
+		size_t run = 1;
+		while (run < max && run < packets.size() && Sendable(packets[run])) {
+			size_t size = packets[run].Size();
+			if (size > segment || total + size > MaxDatagramSize) {
+				break;
+			}
+			total += size;
+			++run;
+			if (size < segment) {
+				break;
+			}
+		}
+		return run;
 	}
 
-	bool Send(const bytearray& src) {
-		return RawSend(src.data(), static_cast<int>(src.size()));
+	std::unique_ptr<SocketDetail::byte_t[]> m_storage = nullptr;
+	size_t m_storagesize = 0;
+	size_t m_slotsize = DefaultSlotSize;
+	bool m_gso = false;
+	bool m_gro = false;
+
+};
+
+
+#ifdef __linux__
+
+/// <summary>
+/// Shared Memory Channel
+/// </summary>
+
+/// <summary>
+/// Packet transport between co-located processes: two SPSC rings (one per direction) in one memfd.
+/// a frame is copied once into the ring and RecvViews reads it in place; each ring's data area is mapped
+/// twice back to back, so a frame never wraps. each end has an eventfd doorbell for data and one for ring space,
+/// rung only while that end sleeps, so a busy stream costs no system call per packet. each end is meant to be driven by one thread.
+/// Create() makes the first end; the second comes from Peer() (same process or fork) or Offer / Join over a UnixSocket.
+/// </summary>
+class ShmChannel {
+public:
+
+	using bytearray = SocketDetail::bytearray;
+
+	static constexpr size_t DefaultCapacity = size_t(1) << 20;
+
+	ShmChannel() = default;
+	~ShmChannel() {
+		Close();
 	}
-	bool Recv(bytearray& dest) {
-		if (dest.empty()) { return false; }
-		return RawRecv(dest.data(), static_cast<int>(dest.size()));
+
+	ShmChannel(const ShmChannel&) = delete;
+	ShmChannel& operator=(const ShmChannel&) = delete;
+	ShmChannel(ShmChannel&& other) noexcept {
+		*this = std::move(other);
+	}
+	ShmChannel& operator=(ShmChannel&& other) noexcept {
+		if (this != &other) {
+			Close();
+			m_memfd = std::exchange(other.m_memfd, -1);
+			m_events = std::exchange(other.m_events, {-1, -1, -1, -1});
+			m_side = other.m_side;
+			m_control = std::exchange(other.m_control, nullptr);
+			m_data = std::exchange(other.m_data, {});
+			m_capacity = std::exchange(other.m_capacity, 0);
+		}
+		return *this;
 	}
 
-	bool Send(const Packet& src) {
-		if (src.CheckHeader()) {
+	/// <summary>
+	/// Makes the first end with capacity bytes per direction (rounded up to a power of two of at least a page).
+	/// </summary>
+	static std::optional<ShmChannel> Create(size_t capacity = DefaultCapacity) {
+		capacity = std::bit_ceil(std::max(capacity, PageSize()));
+		ShmChannel ret;
+		Descriptors fds;
+		fds[0] = memfd_create("socket_h_shm", MFD_CLOEXEC);
+		for (size_t i = 1; i < fds.size(); ++i) {
+			fds[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		}
+		if (!AllValid(fds) || ftruncate(fds[0], static_cast<off_t>(PageSize() + capacity * 2)) != 0) {
+			dbg_print();
+			CloseAll(fds);
+			return std::nullopt;
+		}
+		if (!ret.Map(fds, 0, capacity)) {
+			return std::nullopt;
+		}
+		return ret;
+	}
+	/// <summary>
+	/// The other end of this channel, on duplicated descriptors.
+	/// </summary>
+	std::optional<ShmChannel> Peer() const {
+		if (!IsValid()) {
+			return std::nullopt;
+		}
+		Descriptors fds = Owned();
+		for (int& fd : fds) {
+			fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		}
+		if (!AllValid(fds)) {
+			dbg_print();
+			CloseAll(fds);
+			return std::nullopt;
+		}
+		ShmChannel ret;
+		if (!ret.Map(fds, 1 - m_side, 0)) {
+			return std::nullopt;
+		}
+		return ret;
+	}
+	/// <summary>
+	/// Hands the other end to the process on s (SCM_RIGHTS). the peer calls Join(s).
+	/// </summary>
+	template<class sockbase>
+	bool Offer(basic_TCPSocket<UnixAddress, sockbase>& s) const {
+		if (!IsValid()) {
 			return false;
 		}
-		return Send(src.GetBuffer());
+		Descriptors fds = Owned();
+		return s.Send(Packet(static_cast<uint32_t>(1 - m_side)), std::span<const int>(fds));
 	}
-	std::optional<Packet> Recv() {
-		bytearray head(Packet::HeaderSize);
-		if (!Recv(head)) {
+	template<class sockbase>
+	static std::optional<ShmChannel> Join(basic_TCPSocket<UnixAddress, sockbase>& s) {
+		std::vector<int> fds;
+		auto pak = s.Recv(fds);
+		std::optional<uint32_t> side = pak ? pak->template Get<uint32_t>() : std::nullopt;
+		if (fds.size() != std::tuple_size_v<Descriptors> || !side || *side > 1) {
+			CloseAll(fds);
 			return std::nullopt;
 		}
-		Packet pak;
-		pak.SetBuffer(std::move(head));
-		bytearray data(pak.GetHeader()->Size);
-		if (!Recv(data)) {
+		// Map owns the descriptors from here on, and closes them when it fails
+		Descriptors owned;
+		std::copy(fds.begin(), fds.end(), owned.begin());
+		ShmChannel ret;
+		if (!ret.Map(owned, static_cast<int>(*side), 0)) {
 			return std::nullopt;
 		}
-		return Packet(pak.GetHeader()->Type, data);
+		return ret;
 	}
 
-	bool EncryptionSend(const bytearray& src) {
-		bytearray target;
-		return Encrypt(src, target) && Send(target);
+	/// <summary>
+	/// Marks this end closed and wakes the peer, which drains what is left and then sees the close.
+	/// </summary>
+	void Close() {
+		if (m_control != nullptr) {
+			m_control->closed.fetch_or(1u << m_side);
+			// the peer may be waiting for data or for space
+			Doorbell(DataEvent(1 - m_side));
+			Doorbell(SpaceEvent(1 - m_side));
+			munmap(m_control, PageSize());
+		}
+		for (auto data : m_data) {
+			if (data != nullptr) {
+				munmap(data, m_capacity * 2);
+			}
+		}
+		CloseAll(Owned());
+		m_memfd = -1;
+		m_events = {-1, -1, -1, -1};
+		m_control = nullptr;
+		m_data = {};
+		m_capacity = 0;
 	}
-	bool EncryptionRecv(bytearray& dest) {
-		return Recv(dest) && Decrypt(dest, dest);
+	bool IsValid() const {
+		return m_control != nullptr;
+	}
+	operator bool() const {
+		return IsValid();
+	}
+	bool PeerClosed() const {
+		return m_control == nullptr || (m_control->closed.load(std::memory_order_acquire) & (1u << (1 - m_side))) != 0;
+	}
+	// readable when the peer wrote; register it with an EventLoop and drain with RecvViews / RecvAll
+	int Handle() const {
+		return DataEvent(m_side);
+	}
+	size_t Capacity() const {
+		return m_capacity;
 	}
 
-	bool EncryptionSend(const Packet& src) {
+	bool Send(const Packet& src, int timeout = -1) {
 		if (src.CheckHeader()) {
 			return false;
 		}
-		bytearray data(src.GetBuffer().begin() + Packet::HeaderSize, src.GetBuffer().end());
-		bool flag = Encrypt(data, data);
-		Packet pak = Packet(src.GetHeader()->Type, data);
-		return flag && Send(pak);
+		SocketDetail::byte_view frame = src.GetBuffer();
+		return Write(std::span(&frame, 1), frame.size(), timeout);
 	}
-	std::optional<Packet> EncryptionRecv() {
-		bytearray head(Packet::HeaderSize);
-		if (!Recv(head)) {
-			return std::nullopt;
+	/// <summary>
+	/// Writes head and the payload spans straight into the ring. head.Size is filled in.
+	/// </summary>
+	bool Send(Header head, std::span<const SocketDetail::byte_view> payloads, int timeout = -1) {
+		size_t size = 0;
+		for (auto&& p : payloads) {
+			size += p.size();
 		}
-		Packet pak;
-		pak.SetBuffer(std::move(head));
-		bytearray data(pak.GetHeader()->Size);
-		if (!EncryptionRecv(data)) {
-			return std::nullopt;
+		if (size > UINT32_MAX) {
+			return false;
 		}
-		return Packet(pak.GetHeader()->Type, data);
+		head.Size = static_cast<uint32_t>(size);
+		SocketDetail::byte_view header(reinterpret_cast<const SocketDetail::byte_t*>(&head), Packet::HeaderSize);
+		return Write(std::span(&header, 1), Packet::HeaderSize + size, timeout, payloads);
+	}
+	bool Send(Header head, std::initializer_list<SocketDetail::byte_view> payloads, int timeout = -1) {
+		return Send(head, std::span(payloads.begin(), payloads.size()), timeout);
 	}
 
-	std::future<bool> ASyncSend(const bytearray& src) {
-		return std::async(std::launch::async, [&]() {
-			return this->Send(src);
-		});
+	std::optional<Packet> Recv() {
+		return Recv(-1);
 	}
-	std::future<bool> ASyncRecv(bytearray& dest) {
-		return std::async(std::launch::async, [&]() {
-			return this->Recv(dest);
-		});
+	/// <summary>
+	/// Waits up to timeout [ms] (-1 = infinite) for a packet. nullopt on timeout, or once the peer closed and the ring is empty.
+	/// </summary>
+	std::optional<Packet> Recv(int timeout) {
+		auto deadline = SocketTraits::Deadline(timeout);
+		const Header* head = nullptr;
+		while ((head = Front()) == nullptr) {
+			if (PeerClosed() || !Sleep(In().readerWaiting, Handle(), [&]() { return Front() != nullptr || PeerClosed(); }, deadline)) {
+				return std::nullopt;
+			}
+		}
+		SocketDetail::byte_view frame(reinterpret_cast<const SocketDetail::byte_t*>(head), Packet::HeaderSize + head->Size);
+		Packet pak;
+		pak.SetBuffer(bytearray(frame.begin(), frame.end()));
+		Pop(frame.size());
+		return pak;
 	}
-
-	std::future<bool> ASyncSend(const Packet& src) {
-		return std::async(std::launch::async, [&]() {
-			return this->Send(src);
-		});
+	/// <summary>
+	/// Hands every packet in the ring to f(const Header&, byte_view) in place, without blocking.
+	/// the views are valid only during the call. returns the number of packets, or -1 once the peer closed and the ring is empty.
+	/// </summary>
+	template<class F>
+	int RecvViews(F&& f) {
+		if (!IsValid()) {
+			return -1;
+		}
+		Drain(Handle());
+		int ret = 0;
+		while (true) {
+			while (const Header* head = Front()) {
+				f(*head, SocketDetail::byte_view(reinterpret_cast<const SocketDetail::byte_t*>(head) + Packet::HeaderSize, head->Size));
+				Pop(Packet::HeaderSize + head->Size);
+				++ret;
+			}
+			// ask for the doorbell before leaving, so the next packet makes Handle() readable
+			In().readerWaiting.store(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (Front() == nullptr) {
+				break;
+			}
+			In().readerWaiting.store(0, std::memory_order_relaxed);
+		}
+		return ret == 0 && PeerClosed() ? -1 : ret;
 	}
-	std::future<std::optional<Packet>> ASyncRecv() {
-		return std::async(std::launch::async, [&]() {
-			return this->Recv();
+	template<class F>
+	int RecvAll(F&& f) {
+		return RecvViews([&](const Header& head, SocketDetail::byte_view payload) {
+			bytearray frame(Packet::HeaderSize + payload.size());
+			std::memcpy(frame.data(), &head, Packet::HeaderSize);
+			std::memcpy(frame.data() + Packet::HeaderSize, payload.data(), payload.size());
+			Packet pak;
+			pak.SetBuffer(std::move(frame));
+			f(std::move(pak));
 		});
 	}
 
-	std::future<bool> ASyncEncryptionSend(const bytearray& src) {
-		return std::async(std::launch::async, [&]() {
-			return this->EncryptionSend(src);
-		});
+private:
+
+	struct RingState {
+		alignas(64) std::atomic<uint64_t> head{0};
+		alignas(64) std::atomic<uint64_t> tail{0};
+		alignas(64) std::atomic<uint32_t> readerWaiting{0};
+		std::atomic<uint32_t> writerWaiting{0};
+	};
+	// first page of the memfd; ring i carries the frames written by side i
+	struct Control {
+		static constexpr uint64_t Magic = 0x534f434b53484d31ULL;
+		uint64_t magic = Magic;
+		uint64_t capacity = 0;
+		std::atomic<uint32_t> closed{0};
+		RingState rings[2];
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free);
+
+	static size_t PageSize() {
+		static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		return size;
 	}
-	std::future<bool> ASyncEncryptionRecv(bytearray& dest) {
-		return std::async(std::launch::async, [&]() {
-			return this->EncryptionRecv(dest);
-		});
+	static constexpr size_t Align(size_t size) {
+		return (size + 7) & ~size_t(7);
 	}
-
-	std::future<bool> ASyncEncryptionSend(const Packet& src) {
-		return std::async(std::launch::async, [&]() {
-			return this->EncryptionSend(src);
-		});
+	static void Doorbell(int fd) {
+		uint64_t one = 1;
+		if (::write(fd, &one, sizeof(one)) < 0) {
+			dbg_print();
+		}
 	}
-	std::future<std::optional<Packet>> ASyncEncryptionRecv() {
-		return std::async(std::launch::async, [&]() {
-			return this->EncryptionRecv();
-		});
+	static void Drain(int fd) {
+		uint64_t count;
+		if (::read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+			dbg_print();
+		}
 	}
 
-	AES128 CryptEngine;
-
-protected:
+	// memfd, then the data doorbells of side 0 / 1, then their space doorbells
+	using Descriptors = std::array<int, 5>;
 
-	bool Crypt(AES128::byte_view src, AES128::byte_ref dest, typename AES128::cryptmode_t mode) {
-		if (!CryptEngine.IsInit()) {
-			return false;
+	static bool AllValid(std::span<const int> fds) {
+		for (int fd : fds) {
+			if (fd < 0) {
+				return false;
+			}
 		}
-		return ((&CryptEngine)->*mode)(src, dest, src.size());
+		return true;
 	}
-	bool Encrypt(AES128::byte_view src, AES128::byte_ref dest) {
-		return Crypt(src, dest, &AES128::CTREncrypt);
+	static void CloseAll(std::span<const int> fds) {
+		for (int fd : fds) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
 	}
-	bool Decrypt(AES128::byte_view src, AES128::byte_ref dest) {
-		return Crypt(src, dest, &AES128::CTRDecrypt);
+	Descriptors Owned() const {
+		return {m_memfd, m_events[0], m_events[1], m_events[2], m_events[3]};
 	}
-
-};
-
-
-/// <summary>
-/// TCP Protocol Server
-/// </summary>
-
-template<class ipT, class sockbase = SocketBase<ipT, Protocol::TCP>>
-class basic_TCPServer : public sockbase {
-public:
-
-	using TCPSocket = basic_TCPSocket<ipT>;
-
-	basic_TCPServer() : sockbase() {}
-	basic_TCPServer(uint16_t port) : basic_TCPServer() {
-		Listen(port);
+	// rung by the peer when it wrote into side's inbound ring
+	int DataEvent(int side) const {
+		return m_events[side];
 	}
-
-	basic_TCPServer(const basic_TCPServer&) = delete;
-	basic_TCPServer(basic_TCPServer&& other) noexcept : sockbase(std::move(other)) {}
-
-	basic_TCPServer& operator=(const basic_TCPServer&) = delete;
-	basic_TCPServer& operator=(basic_TCPServer&& other) noexcept {
-		return *static_cast<basic_TCPServer*>(sockbase::Copy(&other));
+	// rung by the peer when it freed room in side's outbound ring
+	int SpaceEvent(int side) const {
+		return m_events[2 + side];
 	}
 
-	bool Bind(typename sockbase::IPType addr) {
-		if (bind(sockbase::sock(), addr, sizeof(typename sockbase::IPType)) < 0) {
+	// takes ownership of the descriptors; capacity 0 joins an existing channel
+	bool Map(const Descriptors& fds, int side, size_t capacity) {
+		int memfd = fds[0];
+		m_memfd = memfd;
+		m_events = {fds[1], fds[2], fds[3], fds[4]};
+		m_side = side;
+		if (!AllValid(fds)) {
+			Close();
+			return false;
+		}
+		void* control = mmap(nullptr, PageSize(), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+		if (control == MAP_FAILED) {
 			dbg_print();
+			Close();
 			return false;
 		}
-		int opt = 1;
-		setsockopt(sockbase::sock(), SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(int));
+		if (capacity != 0) {
+			static_assert(sizeof(Control) <= 4096);
+			m_control = new (control) Control();
+			m_control->capacity = capacity;
+		}
+		else {
+			m_control = static_cast<Control*>(control);
+			capacity = static_cast<size_t>(m_control->capacity);
+			struct stat st = {};
+			if (m_control->magic != Control::Magic || !std::has_single_bit(capacity) || capacity < PageSize() ||
+				fstat(memfd, &st) != 0 || static_cast<size_t>(st.st_size) < PageSize() + capacity * 2) {
+				munmap(control, PageSize());
+				m_control = nullptr;
+				Close();
+				return false;
+			}
+		}
+		m_capacity = capacity;
+		for (int i = 0; i < 2; ++i) {
+			m_data[i] = MapMirror(memfd, PageSize() + capacity * i, capacity);
+			if (m_data[i] == nullptr) {
+				Close();
+				return false;
+			}
+		}
 		return true;
 	}
-	bool Listen(uint16_t port, int backlog = 128) {
-		this->Bind(typename sockbase::IPType(port));
-		if (listen(sockbase::sock(), backlog) != 0) {
+	// maps the ring at offset twice in a row so [pos, pos + frame) is always contiguous
+	static SocketDetail::byte_t* MapMirror(int memfd, size_t offset, size_t capacity) {
+		void* base = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
 			dbg_print();
-			return false;
+			return nullptr;
 		}
-		return true;
+		auto ret = static_cast<SocketDetail::byte_t*>(base);
+		for (size_t half = 0; half < 2; ++half) {
+			if (mmap(ret + capacity * half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, static_cast<off_t>(offset)) == MAP_FAILED) {
+				dbg_print();
+				munmap(base, capacity * 2);
+				return nullptr;
+			}
+		}
+		return ret;
 	}
-	void StopListen() {
-		*this = basic_TCPServer();
+
+	RingState& Out() {
+		return m_control->rings[m_side];
+	}
+	RingState& In() {
+		return m_control->rings[1 - m_side];
 	}
-	std::optional<TCPSocket> Accept() {
-		int ret = sockbase::Poll(std::addressof(sockbase::pfd), 1, 0);
 
-		if (!(ret > 0 && (sockbase::pfd.revents & POLLIN))) {
-			return std::nullopt;
+	bool Write(std::span<const SocketDetail::byte_view> front, size_t size, int timeout, std::span<const SocketDetail::byte_view> rest = {}) {
+		size_t record = Align(size);
+		if (!IsValid() || record > m_capacity) {
+			return false;
 		}
-
-		TCPSocket client = accept(sockbase::sock(), nullptr, nullptr);
-		if (!client.IsValid()) {
+		RingState& ring = Out();
+		uint64_t head = ring.head.load(std::memory_order_relaxed);
+		auto fits = [&]() { return m_capacity - (head - ring.tail.load(std::memory_order_acquire)) >= record; };
+		auto deadline = SocketTraits::Deadline(timeout);
+		while (!fits()) {
+			if (PeerClosed() || !Sleep(ring.writerWaiting, SpaceEvent(m_side), [&]() { return fits() || PeerClosed(); }, deadline)) {
+				return false;
+			}
+		}
+		if (PeerClosed()) {
+			return false;
+		}
+		SocketDetail::byte_t* dest = m_data[m_side] + (head & (m_capacity - 1));
+		for (auto parts : {front, rest}) {
+			for (auto&& p : parts) {
+				std::memcpy(dest, p.data(), p.size());
+				dest += p.size();
+			}
+		}
+		ring.head.store(head + record, std::memory_order_release);
+		Notify(ring.readerWaiting, DataEvent(1 - m_side));
+		return true;
+	}
+	// the frame at the read position, or nullptr when the ring is empty
+	const Header* Front() {
+		RingState& ring = In();
+		uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+		uint64_t head = ring.head.load(std::memory_order_acquire);
+		if (head == tail) {
+			return nullptr;
+		}
+		auto ret = reinterpret_cast<const Header*>(m_data[1 - m_side] + (tail & (m_capacity - 1)));
+		if (Align(Packet::HeaderSize + ret->Size) > head - tail) {
+			// a frame larger than what was published: the peer is broken
 			dbg_print();
-			return std::nullopt;
+			m_control->closed.fetch_or(1u << (1 - m_side));
+			return nullptr;
 		}
-		client.pfd.events = POLLIN;
-		return client;
+		return ret;
+	}
+	void Pop(size_t size) {
+		RingState& ring = In();
+		ring.tail.store(ring.tail.load(std::memory_order_relaxed) + Align(size), std::memory_order_release);
+		Notify(ring.writerWaiting, SpaceEvent(1 - m_side));
+	}
+	void Notify(std::atomic<uint32_t>& waiting, int doorbell) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting.load(std::memory_order_relaxed) != 0 && waiting.exchange(0) != 0) {
+			Doorbell(doorbell);
+		}
+	}
+	// sleeps on one of this end's doorbells until woken or the deadline; false only when ready() still fails after a timeout.
+	// data and space have a doorbell each, so a writer waiting for room never swallows the wakeup RecvViews' caller polls for
+	template<class F>
+	bool Sleep(std::atomic<uint32_t>& waiting, int doorbell, F&& ready, SocketTraits::deadline_t deadline) {
+		waiting.store(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (ready()) {
+			waiting.store(0, std::memory_order_relaxed);
+			return true;
+		}
+		struct pollfd pfd = {doorbell, POLLIN, 0};
+		int ret;
+		do {
+			ret = ::poll(&pfd, 1, SocketTraits::Remaining(deadline));
+		} while (ret < 0 && errno == EINTR);
+		waiting.store(0, std::memory_order_relaxed);
+		if (ret > 0) {
+			Drain(doorbell);
+			return true;
+		}
+		return ready();
 	}
 
+	int m_memfd = -1;
+	std::array<int, 4> m_events{-1, -1, -1, -1};
+	int m_side = 0;
+	Control* m_control = nullptr;
+	std::array<SocketDetail::byte_t*, 2> m_data{};
+	size_t m_capacity = 0;
 };
 
+#endif // __linux__
+
 
 /// <summary>
 /// using typedef
@@ -694,22 +6002,64 @@ public:
 using IPAddress = IPAddressBase<IPVersion::IPv4>;
 using IPv6Address = IPAddressBase<IPVersion::IPv6>;
 
+using Resolver = basic_Resolver<IPAddress>;
+using ResolverV6 = basic_Resolver<IPv6Address>;
+
 using TCPSocket = basic_TCPSocket<IPAddress>;
 using TCPSocketV6 = basic_TCPSocket<IPv6Address>;
 
 using TCPServer = basic_TCPServer<IPAddress>;
 using TCPServerV6 = basic_TCPServer<IPv6Address>;
 
+using UnixSocket = basic_TCPSocket<UnixAddress>;
+using UnixServer = basic_TCPServer<UnixAddress>;
+
+using TCPShardedServer = basic_TCPShardedServer<IPAddress>;
+using TCPShardedServerV6 = basic_TCPShardedServer<IPv6Address>;
+
+using TCPHeartbeat = HeartbeatMonitor<TCPSocket>;
+using TCPHeartbeatV6 = HeartbeatMonitor<TCPSocketV6>;
+
+using TCPConnectionPool = ConnectionPool<IPAddress>;
+using TCPConnectionPoolV6 = ConnectionPool<IPv6Address>;
+
+using TCPRpcChannel = RpcChannel<TCPSocket>;
+using TCPRpcChannelV6 = RpcChannel<TCPSocketV6>;
+
+using TCPBroadcastHub = BroadcastHub<TCPSocket>;
+using TCPBroadcastHubV6 = BroadcastHub<TCPSocketV6>;
+
+using UDPSocket = basic_UDPSocket<IPAddress>;
+using UDPSocketV6 = basic_UDPSocket<IPv6Address>;
+
 #ifdef SOCKET_H_USE_NAMESPACE
 }
+#define SOCKET_H_NAMESPACE NetIO::
+#else
+#define SOCKET_H_NAMESPACE
 #endif // SOCKET_H_USE_NAMESPACE
 
+/// <summary>
+/// std::hash for IPAddressBase (the port is ignored) and UnixAddress, consistent with their operator==
+/// </summary>
+
+namespace std {
+	template<SOCKET_H_NAMESPACE IPVersion _type>
+	struct hash<SOCKET_H_NAMESPACE IPAddressBase<_type>> {
+		size_t operator()(const SOCKET_H_NAMESPACE IPAddressBase<_type>& addr) const noexcept {
+			return addr.Hash();
+		}
+	};
+	template<>
+	struct hash<SOCKET_H_NAMESPACE UnixAddress> {
+		size_t operator()(const SOCKET_H_NAMESPACE UnixAddress& addr) const noexcept {
+			return addr.Hash();
+		}
+	};
+}
+
+#undef SOCKET_H_NAMESPACE
 #undef dbg_print
 #undef _last_error
 #undef SOCKET_H_USE_NAMESPACE
-
-
-
-
-// TODO:
-// 	Datagram (UDP) Protocol implement
+#undef SOCKET_H_IO_URING
@@ -0,0 +1,220 @@
+#pragma once
+#include "common.h"
+
+/// <summary>
+/// Timer Wheel
+/// </summary>
+
+/// <summary>
+/// Hierarchical timing wheel (Levels x Slots buckets of one tick each level up).
+/// Arm and Cancel are O(1): timers are nodes of intrusive lists in a slab, and a timer id carries
+/// a generation so a stale id never cancels a reused node. Advance() fires due timers and
+/// cascades the higher levels down as the lower ones wrap.
+/// </summary>
+class TimerWheel {
+public:
+	using clock_t = std::chrono::steady_clock;
+	using time_point = clock_t::time_point;
+	using duration = std::chrono::milliseconds;
+	using callback_t = std::function<void()>;
+	// 0 never names a timer
+	using timer_t = uint64_t;
+
+	static constexpr size_t Levels = 4;
+	static constexpr size_t SlotBits = 8;
+	static constexpr size_t Slots = size_t(1) << SlotBits;
+	// farthest delay in ticks; longer delays are clamped
+	static constexpr uint64_t MaxTicks = (uint64_t(1) << (SlotBits * Levels)) - 1;
+
+	explicit TimerWheel(duration tick = duration(10), time_point now = clock_t::now()) : m_tick(std::max(tick, duration(1))), m_origin(now) {
+		m_heads.fill(Nil);
+	}
+
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+
+	/// <summary>
+	/// Calls cb once delay after now, rounded up to the next tick (never early).
+	/// </summary>
+	timer_t Arm(duration delay, callback_t cb, time_point now = clock_t::now()) {
+		auto at = std::chrono::ceil<duration>(now - m_origin) + std::max(delay, duration(0));
+		uint64_t expire = static_cast<uint64_t>(std::max<duration::rep>((at.count() + m_tick.count() - 1) / m_tick.count(), 0));
+		uint32_t index = Allocate();
+		Node& node = m_nodes[index];
+		node.expire = std::clamp(expire, m_now + 1, m_now + MaxTicks);
+		node.callback = std::move(cb);
+		Insert(index);
+		++m_count;
+		return (static_cast<uint64_t>(node.generation) << 32) | (index + 1);
+	}
+	bool Cancel(timer_t id) {
+		uint32_t index = 0;
+		if (!Find(id, index)) {
+			return false;
+		}
+		Unlink(index);
+		Free(index);
+		--m_count;
+		return true;
+	}
+	bool IsArmed(timer_t id) const {
+		uint32_t index = 0;
+		return Find(id, index);
+	}
+	size_t Count() const {
+		return m_count;
+	}
+
+	duration Tick() const {
+		return m_tick;
+	}
+	// ticks elapsed since construction as of the last Advance(); a clock that costs no system call
+	uint64_t Ticks() const {
+		return m_now;
+	}
+
+	/// <summary>
+	/// Fires every timer due at now. callbacks may arm and cancel timers.
+	/// returns the number of fired timers.
+	/// </summary>
+	size_t Advance(time_point now = clock_t::now()) {
+		uint64_t target = now > m_origin ? static_cast<uint64_t>((now - m_origin) / m_tick) : 0;
+		size_t fired = 0;
+		while (m_now < target) {
+			if (m_count == 0) {
+				m_now = target;
+				break;
+			}
+			++m_now;
+			for (size_t level = 1; level < Levels && (m_now & Mask(level)) == 0; ++level) {
+				Cascade(level);
+			}
+			uint32_t& head = m_heads[SlotIndex(0, m_now)];
+			while (head != Nil) {
+				uint32_t index = head;
+				Unlink(index);
+				callback_t cb = std::move(m_nodes[index].callback);
+				Free(index);
+				--m_count;
+				++fired;
+				cb();
+			}
+		}
+		return fired;
+	}
+
+	/// <summary>
+	/// Milliseconds until Advance() next has work (a due timer or a cascade), or -1 when nothing is armed.
+	/// meant as the wait timeout of an event loop.
+	/// </summary>
+	int NextTimeout(time_point now = clock_t::now()) const {
+		if (m_count == 0) {
+			return -1;
+		}
+		uint64_t next = (m_now | (Slots - 1)) + 1;
+		for (uint64_t tick = m_now + 1; tick < next; ++tick) {
+			if (m_heads[SlotIndex(0, tick)] != Nil) {
+				next = tick;
+				break;
+			}
+		}
+		auto left = std::chrono::ceil<duration>(m_origin + m_tick * next - now).count();
+		return static_cast<int>(std::clamp<decltype(left)>(left, 0, INT_MAX));
+	}
+
+private:
+
+	static constexpr uint32_t Nil = UINT32_MAX;
+
+	struct Node {
+		uint64_t expire = 0;
+		callback_t callback;
+		uint32_t next = Nil;
+		uint32_t prev = Nil;
+		uint32_t slot = Nil;
+		uint32_t generation = 0;
+	};
+
+	static constexpr uint64_t Mask(size_t level) {
+		return (uint64_t(1) << (SlotBits * level)) - 1;
+	}
+	static constexpr size_t SlotIndex(size_t level, uint64_t tick) {
+		return level * Slots + static_cast<size_t>((tick >> (SlotBits * level)) & (Slots - 1));
+	}
+
+	bool Find(timer_t id, uint32_t& index) const {
+		uint64_t low = id & UINT32_MAX;
+		if (low == 0 || low > m_nodes.size()) {
+			return false;
+		}
+		index = static_cast<uint32_t>(low - 1);
+		const Node& node = m_nodes[index];
+		return node.slot != Nil && node.generation == static_cast<uint32_t>(id >> 32);
+	}
+
+	uint32_t Allocate() {
+		if (m_free != Nil) {
+			uint32_t index = m_free;
+			m_free = m_nodes[index].next;
+			return index;
+		}
+		m_nodes.emplace_back();
+		return static_cast<uint32_t>(m_nodes.size() - 1);
+	}
+	void Free(uint32_t index) {
+		Node& node = m_nodes[index];
+		node.callback = nullptr;
+		node.slot = Nil;
+		node.prev = Nil;
+		++node.generation;
+		node.next = m_free;
+		m_free = index;
+	}
+
+	void Insert(uint32_t index) {
+		Node& node = m_nodes[index];
+		uint64_t delta = node.expire - m_now;
+		size_t level = 0;
+		while (level + 1 < Levels && delta > Mask(level + 1)) {
+			++level;
+		}
+		node.slot = static_cast<uint32_t>(SlotIndex(level, node.expire));
+		node.prev = Nil;
+		node.next = m_heads[node.slot];
+		if (node.next != Nil) {
+			m_nodes[node.next].prev = index;
+		}
+		m_heads[node.slot] = index;
+	}
+	void Unlink(uint32_t index) {
+		Node& node = m_nodes[index];
+		if (node.prev != Nil) {
+			m_nodes[node.prev].next = node.next;
+		}
+		else {
+			m_heads[node.slot] = node.next;
+		}
+		if (node.next != Nil) {
+			m_nodes[node.next].prev = node.prev;
+		}
+		node.next = node.prev = Nil;
+	}
+	// re-files the slot of level that has just come due into the levels below
+	void Cascade(size_t level) {
+		size_t slot = SlotIndex(level, m_now);
+		uint32_t index = std::exchange(m_heads[slot], Nil);
+		while (index != Nil) {
+			uint32_t next = m_nodes[index].next;
+			Insert(index);
+			index = next;
+		}
+	}
+
+	duration m_tick;
+	time_point m_origin;
+	uint64_t m_now = 0;
+	size_t m_count = 0;
+	std::vector<Node> m_nodes;
+	uint32_t m_free = Nil;
+	std::array<uint32_t, Levels * Slots> m_heads{};
+};
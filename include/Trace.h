@@ -0,0 +1,215 @@
+#pragma once
+#include "common.h"
+
+/// <summary>
+/// Trace
+/// </summary>
+
+/// <summary>
+/// Trace points of the hot paths (RawSend, RawRecv, Recv, EncryptionSend, AES128::CTR, SHAKE256::SPONGE).
+/// built only with SOCKET_H_ENABLE_TRACE defined; otherwise trace_scope / trace_bytes expand to nothing.
+/// every thread records into a ring of its own (no locks, no allocation after the first event), the oldest
+/// events being overwritten; Trace::ChromeJSON turns the rings into Chrome trace-event JSON, which
+/// chrome://tracing and Perfetto both open.
+/// </summary>
+class Trace {
+public:
+
+	// events kept per thread; a power of two
+#ifdef SOCKET_H_TRACE_CAPACITY
+	static constexpr size_t Capacity = SOCKET_H_TRACE_CAPACITY;
+#else
+	static constexpr size_t Capacity = size_t(1) << 14;
+#endif // SOCKET_H_TRACE_CAPACITY
+	static_assert(std::has_single_bit(Capacity), "SOCKET_H_TRACE_CAPACITY must be a power of two");
+
+	// timestamps in ticks: the TSC on x86-64 (a few ns to read), steady_clock nanoseconds elsewhere
+	static uint64_t Now() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+		return __builtin_ia32_rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	// recording can be paused at run time; a paused trace point costs one relaxed load
+	static bool Enabled() {
+		return State().enabled.load(std::memory_order_relaxed);
+	}
+	static void Enable(bool flag = true) {
+		State().enabled.store(flag, std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Appends one complete event to the ring of the calling thread. name must outlive the trace (a literal).
+	/// </summary>
+	static void Record(const char* name, uint64_t start, uint64_t end, uint64_t bytes) {
+		Ring& ring = Local();
+		uint64_t head = ring.head.load(std::memory_order_relaxed);
+		Event& e = ring.events[head & (Capacity - 1)];
+		e.name.store(name, std::memory_order_relaxed);
+		e.start.store(start, std::memory_order_relaxed);
+		e.end.store(end, std::memory_order_relaxed);
+		e.bytes.store(bytes, std::memory_order_relaxed);
+		ring.head.store(head + 1, std::memory_order_release);
+	}
+
+	/// <summary>
+	/// Chrome trace-event JSON of every event still in the rings, timestamps in microseconds.
+	/// may run while other threads keep recording; events overwritten during the copy are left out.
+	/// </summary>
+	static std::string ChromeJSON() {
+		Registry& state = State();
+		std::vector<std::shared_ptr<Ring>> rings;
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			rings = state.rings;
+		}
+		uint64_t origin = state.origin;
+		double nanos = NanosPerTick();
+
+		std::string ret = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		bool first = true;
+		std::array<char, 256> buf{};
+		for (auto&& ring : rings) {
+			for (auto&& e : ring->Copy()) {
+				double ts = static_cast<double>(e.start - origin) * nanos / 1000.0;
+				double dur = static_cast<double>(e.end - e.start) * nanos / 1000.0;
+				int n = std::snprintf(buf.data(), buf.size(), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%llu}}",
+					first ? "" : ",", e.name, ring->tid, ts, dur, static_cast<unsigned long long>(e.bytes));
+				ret.append(buf.data(), static_cast<size_t>(std::clamp<int>(n, 0, static_cast<int>(buf.size()) - 1)));
+				first = false;
+			}
+		}
+		ret += "]}";
+		return ret;
+	}
+	static bool Dump(const std::filesystem::path& path) {
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		std::string json = ChromeJSON();
+		return ofs.is_open() && ofs.write(json.data(), static_cast<std::streamsize>(json.size())).good();
+	}
+	// forgets the recorded events. threads must not be recording meanwhile
+	static void Clear() {
+		Registry& state = State();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		for (auto&& ring : state.rings) {
+			ring->head.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+
+	struct Event {
+		std::atomic<const char*> name = nullptr;
+		std::atomic<uint64_t> start = 0;
+		std::atomic<uint64_t> end = 0;
+		std::atomic<uint64_t> bytes = 0;
+	};
+	struct Copied {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+		uint64_t bytes;
+	};
+	struct Ring {
+		std::unique_ptr<Event[]> events = std::make_unique<Event[]>(Capacity);
+		std::atomic<uint64_t> head = 0;
+		uint32_t tid = 0;
+
+		// copies the ring, then drops what the writer may have overwritten while it was read
+		std::vector<Copied> Copy() const {
+			uint64_t last = head.load(std::memory_order_acquire);
+			uint64_t first = last > Capacity ? last - Capacity : 0;
+			std::vector<Copied> ret;
+			ret.reserve(static_cast<size_t>(last - first));
+			for (uint64_t i = first; i < last; ++i) {
+				const Event& e = events[i & (Capacity - 1)];
+				ret.push_back(Copied{e.name.load(std::memory_order_relaxed), e.start.load(std::memory_order_relaxed), e.end.load(std::memory_order_relaxed), e.bytes.load(std::memory_order_relaxed)});
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t now = head.load(std::memory_order_relaxed);
+			// event now is being stored into the slot of event now - Capacity, so that one is gone as well
+			uint64_t valid = now >= Capacity ? now - Capacity + 1 : 0;
+			if (valid > first) {
+				ret.erase(ret.begin(), ret.begin() + static_cast<ptrdiff_t>(std::min(valid, last) - first));
+			}
+			return ret;
+		}
+	};
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::shared_ptr<Ring>> rings;
+		std::atomic<bool> enabled = true;
+		// the tick / clock pair the timestamps are converted against
+		uint64_t origin = Now();
+		std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	};
+
+	static Registry& State() {
+		static Registry state;
+		return state;
+	}
+	// rings stay registered after their thread exits, so its events can still be dumped
+	static Ring& Local() {
+		thread_local Ring* ring = [] {
+			Registry& state = State();
+			auto ret = std::make_shared<Ring>();
+			std::lock_guard<std::mutex> lock(state.mutex);
+			ret->tid = static_cast<uint32_t>(state.rings.size() + 1);
+			state.rings.push_back(ret);
+			return ret.get();
+		}();
+		return *ring;
+	}
+	static double NanosPerTick() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+		const Registry& state = State();
+		uint64_t ticks = Now() - state.origin;
+		auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state.epoch).count();
+		return ticks == 0 ? 1.0 : static_cast<double>(nanos) / static_cast<double>(ticks);
+#else
+		return 1.0;
+#endif
+	}
+};
+
+/// <summary>
+/// One trace event spanning its lifetime. usable in constexpr functions: nothing is recorded
+/// during constant evaluation.
+/// </summary>
+class TraceScope {
+public:
+	constexpr TraceScope(const char* name, uint64_t bytes) : m_name(name), m_bytes(bytes) {
+		if (!std::is_constant_evaluated() && Trace::Enabled()) {
+			m_start = Trace::Now();
+		}
+	}
+	constexpr ~TraceScope() {
+		if (!std::is_constant_evaluated() && m_start != 0) {
+			Trace::Record(m_name, m_start, Trace::Now(), m_bytes);
+		}
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	// for sizes known only at the end, e.g. a received packet
+	constexpr void Bytes(uint64_t bytes) {
+		m_bytes = bytes;
+	}
+
+private:
+	const char* m_name;
+	uint64_t m_bytes;
+	uint64_t m_start = 0;
+};
+
+#undef trace_scope
+#undef trace_bytes
+#ifdef SOCKET_H_ENABLE_TRACE
+#define trace_scope(name, bytes) TraceScope _trace_scope((name), static_cast<uint64_t>(bytes))
+#define trace_bytes(bytes) _trace_scope.Bytes(static_cast<uint64_t>(bytes))
+#else
+#define trace_scope(name, bytes)
+#define trace_bytes(bytes)
+#endif // SOCKET_H_ENABLE_TRACE
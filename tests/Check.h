@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdio>
+
+// minimal assertion for the test executables: reports the failing expression and keeps going,
+// main returns Failures() so ctest sees a non-zero exit code
+namespace Check {
+
+	inline int& Failures() {
+		static int count = 0;
+		return count;
+	}
+
+	inline bool Report(bool ok, const char* expr, const char* file, int line) {
+		if (!ok) {
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+			++Failures();
+		}
+		return ok;
+	}
+
+}
+
+#define CHECK(expr) ::Check::Report(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
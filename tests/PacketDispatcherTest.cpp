@@ -0,0 +1,156 @@
+#include <utility>
+#include <vector>
+
+#include "../include/PacketDispatcher.h"
+#include "Check.h"
+
+// PacketDispatcher over sparse type_hash_code ids (perfect hash table) and a dense enum range (direct index)
+
+namespace {
+
+	template<size_t N>
+	struct Tag {
+		uint32_t value;
+	};
+
+	constexpr size_t SparseCount = 40;
+
+	enum class Op : uint32_t {
+		First = 1000,
+		Last = First + 31,
+	};
+
+	Op OpAt(uint32_t i) {
+		return static_cast<Op>(static_cast<uint32_t>(Op::First) + i);
+	}
+
+	template<size_t... I>
+	void RegisterTags(PacketDispatcher<std::vector<size_t>&>& dispatcher, std::index_sequence<I...>) {
+		(CHECK(dispatcher.template On<Tag<I>>([](Tag<I> tag, std::vector<size_t>& calls) {
+			CHECK(tag.value == I * 3);
+			calls.push_back(I);
+		})), ...);
+	}
+	template<size_t... I>
+	std::vector<uint32_t> TagTypes(std::index_sequence<I...>) {
+		return {Header::type_hash_code<Tag<I>>()...};
+	}
+	template<size_t... I>
+	std::vector<Packet> TagPackets(std::index_sequence<I...>) {
+		return {Packet(Tag<I>{static_cast<uint32_t>(I * 3)})...};
+	}
+
+	void Sparse() {
+		using seq = std::make_index_sequence<SparseCount>;
+		PacketDispatcher<std::vector<size_t>&> dispatcher;
+		RegisterTags(dispatcher, seq{});
+		std::vector<uint32_t> types = TagTypes(seq{});
+		std::vector<Packet> packets = TagPackets(seq{});
+		CHECK(dispatcher.Size() == SparseCount);
+		CHECK(!dispatcher.IsDense());
+
+		std::vector<size_t> calls;
+		for (size_t i = 0; i < SparseCount; ++i) {
+			CHECK(dispatcher.Contains(types[i]));
+			CHECK(dispatcher.Dispatch(packets[i], calls));
+		}
+		CHECK(calls.size() == SparseCount);
+		for (size_t i = 0; i < calls.size(); ++i) {
+			CHECK(calls[i] == i);
+		}
+
+		// an unknown id, with and without a fallback
+		Packet unknown(Header::type_hash_code<std::vector<Tag<0>>>(), Packet::bytearray(4));
+		CHECK(!dispatcher.Contains(Header::type_hash_code<std::vector<Tag<0>>>()));
+		CHECK(!dispatcher.Dispatch(unknown, calls));
+		std::vector<uint32_t> fallbacks;
+		dispatcher.Otherwise([&](const Packet& pak, std::vector<size_t>&) {
+			fallbacks.push_back(pak.GetHeader()->Type);
+		});
+		CHECK(dispatcher.Dispatch(unknown, calls));
+		CHECK(fallbacks == std::vector<uint32_t>{Header::type_hash_code<std::vector<Tag<0>>>()});
+		fallbacks.clear();
+
+		// the payload is too short for Tag<0>: the handler is not called and the fallback is not used either
+		calls.clear();
+		CHECK(!dispatcher.Dispatch(Packet(types[0], Packet::bytearray(2)), calls));
+		CHECK(calls.empty());
+		CHECK(fallbacks.empty());
+
+		// removing every other id rebuilds the table around the rest
+		for (size_t i = 0; i < SparseCount; i += 2) {
+			CHECK(dispatcher.Remove(types[i]));
+		}
+		CHECK(!dispatcher.Remove(types[0]));
+		CHECK(dispatcher.Size() == SparseCount / 2);
+		calls.clear();
+		for (size_t i = 0; i < SparseCount; ++i) {
+			CHECK(dispatcher.Contains(types[i]) == (i % 2 == 1));
+			CHECK(dispatcher.Dispatch(packets[i], calls));
+		}
+		CHECK(calls.size() == SparseCount / 2);
+		CHECK(fallbacks.size() == SparseCount / 2);
+		for (size_t i = 0; i < calls.size() && i < fallbacks.size(); ++i) {
+			CHECK(calls[i] == i * 2 + 1);
+			CHECK(fallbacks[i] == types[i * 2]);
+		}
+	}
+
+	void Dense() {
+		PacketDispatcher<> dispatcher;
+		std::vector<uint32_t> seen;
+		for (uint32_t i = static_cast<uint32_t>(Op::First); i <= static_cast<uint32_t>(Op::Last); ++i) {
+			CHECK(dispatcher.On(static_cast<Op>(i), [&seen](const Packet& pak) {
+				seen.push_back(pak.GetHeader()->Type);
+			}));
+		}
+		CHECK(dispatcher.IsDense());
+		for (uint32_t i = 0; i < 32; ++i) {
+			CHECK(dispatcher.Contains(static_cast<uint32_t>(OpAt(i))));
+			CHECK(dispatcher.Dispatch(Packet(OpAt(i), "x")));
+		}
+		CHECK(seen.size() == 32);
+		CHECK(seen.front() == static_cast<uint32_t>(Op::First) && seen.back() == static_cast<uint32_t>(Op::Last));
+
+		// below the base, Type - base wraps around and must still miss
+		for (uint32_t type : {0u, 1u, 999u, static_cast<uint32_t>(Op::Last) + 1, 0xffffffffu}) {
+			CHECK(!dispatcher.Contains(type));
+			CHECK(!dispatcher.Dispatch(Packet(type, "x")));
+		}
+
+		// a handler that reports failure, and one whose argument does not deserialize
+		CHECK(dispatcher.On(Op::First, [](const Packet&) { return false; }));
+		CHECK(!dispatcher.Dispatch(Packet(Op::First, "x")));
+		bool called = false;
+		CHECK(dispatcher.On(OpAt(1), [&called](uint64_t) { called = true; }));
+		CHECK(!dispatcher.Dispatch(Packet(OpAt(1), "abc")));
+		CHECK(!called);
+		CHECK(dispatcher.Dispatch(Packet(OpAt(1), uint64_t(7))));
+		CHECK(called);
+		CHECK(dispatcher.Size() == 32);
+
+		// one far id turns the table into a hash, and removing it makes it dense again
+		CHECK(dispatcher.On(0x80000000u, [](const Packet&) {}));
+		CHECK(!dispatcher.IsDense());
+		for (uint32_t i = 0; i < 32; ++i) {
+			CHECK(dispatcher.Contains(static_cast<uint32_t>(OpAt(i))));
+		}
+		CHECK(dispatcher.Contains(0x80000000u));
+		CHECK(dispatcher.Remove(0x80000000u));
+		CHECK(dispatcher.IsDense());
+		CHECK(!dispatcher.Contains(0x80000000u));
+
+		// a malformed packet never reaches a handler
+		CHECK(!dispatcher.Dispatch(Packet()));
+	}
+
+}
+
+int main() {
+	Sparse();
+	Dense();
+	if (Check::Failures() == 0) {
+		std::puts("PacketDispatcherTest: ok");
+	}
+	return Check::Failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include "../include/Socket.h"
+#include "Check.h"
+
+// same-process ShmChannel ends from Create / Peer; each end is driven by one thread as the class requires
+
+namespace {
+
+	using namespace std::chrono_literals;
+
+	constexpr uint32_t DataType = 1;
+
+	Packet Payload(uint32_t seq, size_t size) {
+		Packet::bytearray data(size);
+		for (size_t i = 0; i < size; ++i) {
+			data[i] = static_cast<Packet::byte_t>(seq + i);
+		}
+		std::memcpy(data.data(), &seq, std::min(size, sizeof(seq)));
+		return Packet(DataType, data);
+	}
+
+	bool Readable(int fd) {
+		struct pollfd pfd = {fd, POLLIN, 0};
+		return ::poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN) != 0;
+	}
+
+	// fills a's outbound ring without blocking; returns how many packets went in
+	int Fill(ShmChannel& a, size_t size) {
+		int count = 0;
+		while (a.Send(Payload(count, size), 0)) {
+			++count;
+		}
+		return count;
+	}
+
+	// a writer sleeping on a full ring must not swallow the data doorbell its own RecvViews asked for
+	void WriterDoesNotEatDataDoorbell() {
+		auto a = ShmChannel::Create(4096);
+		CHECK(a.has_value());
+		auto b = a->Peer();
+		CHECK(b.has_value());
+		if (!a || !b) {
+			return;
+		}
+		// a is idle: asks for the doorbell on its inbound ring
+		CHECK(a->RecvViews([](const Header&, Packet::byte_view) {}) == 0);
+		int queued = Fill(*a, 200);
+		CHECK(queued > 0);
+
+		std::thread writer([&]() {
+			CHECK(a->Send(Payload(queued, 200)));
+		});
+		std::this_thread::sleep_for(50ms);
+		// b writes while a's writer sleeps for space, then frees the space
+		CHECK(b->Send(Payload(1000, 16)));
+		int drained = 0;
+		while (drained <= queued) {
+			int ret = b->RecvViews([&](const Header& head, Packet::byte_view payload) {
+				CHECK(head.Type == DataType);
+				uint32_t seq = 0;
+				std::memcpy(&seq, payload.data(), sizeof(seq));
+				CHECK(seq == static_cast<uint32_t>(drained));
+				++drained;
+			});
+			CHECK(ret >= 0);
+			if (ret == 0) {
+				std::this_thread::sleep_for(1ms);
+			}
+		}
+		writer.join();
+		CHECK(drained == queued + 1);
+
+		CHECK(Readable(a->Handle()));
+		int got = a->RecvViews([](const Header& head, Packet::byte_view payload) {
+			CHECK(head.Type == DataType);
+			CHECK(payload.size() == 16);
+		});
+		CHECK(got == 1);
+	}
+
+	// frames of varying sizes run the ring around many times; the mirrored mapping keeps each one contiguous
+	void Wraparound() {
+		auto a = ShmChannel::Create(4096);
+		auto b = a ? a->Peer() : std::nullopt;
+		CHECK(a.has_value() && b.has_value());
+		if (!a || !b) {
+			return;
+		}
+		constexpr uint32_t Count = 2000;
+		std::thread writer([&]() {
+			for (uint32_t i = 0; i < Count; ++i) {
+				if (!CHECK(a->Send(Payload(i, 4 + (i * 37) % 700)))) {
+					return;
+				}
+			}
+		});
+		for (uint32_t i = 0; i < Count; ++i) {
+			auto pak = b->Recv(5000);
+			if (!CHECK(pak.has_value())) {
+				break;
+			}
+			Packet expected = Payload(i, 4 + (i * 37) % 700);
+			CHECK(pak->GetBuffer() == expected.GetBuffer());
+		}
+		writer.join();
+		CHECK(b->RecvViews([](const Header&, Packet::byte_view) {}) == 0);
+	}
+
+	// the survivor reads what was left, then sees the close; a writer blocked on a full ring wakes up
+	void PeerClosed() {
+		auto a = ShmChannel::Create(4096);
+		auto b = a ? a->Peer() : std::nullopt;
+		CHECK(a.has_value() && b.has_value());
+		if (!a || !b) {
+			return;
+		}
+		CHECK(!a->PeerClosed() && !b->PeerClosed());
+		CHECK(b->Send(Payload(0, 32)));
+		CHECK(b->Send(Payload(1, 32)));
+		b->Close();
+		CHECK(a->PeerClosed());
+		CHECK(Readable(a->Handle()));
+		CHECK(a->RecvViews([](const Header&, Packet::byte_view) {}) == 2);
+		CHECK(a->RecvViews([](const Header&, Packet::byte_view) {}) == -1);
+		CHECK(!a->Recv(10).has_value());
+		CHECK(!a->Send(Payload(2, 32)));
+
+		auto c = ShmChannel::Create(4096);
+		auto d = c ? c->Peer() : std::nullopt;
+		CHECK(c.has_value() && d.has_value());
+		if (!c || !d) {
+			return;
+		}
+		CHECK(Fill(*c, 200) > 0);
+		std::thread writer([&]() {
+			CHECK(!c->Send(Payload(0, 200)));
+		});
+		std::this_thread::sleep_for(50ms);
+		d->Close();
+		writer.join();
+		CHECK(c->PeerClosed());
+	}
+
+}
+
+int main() {
+	WriterDoesNotEatDataDoorbell();
+	Wraparound();
+	PeerClosed();
+	if (Check::Failures() == 0) {
+		std::puts("ShmChannelTest: ok");
+	}
+	return Check::Failures() == 0 ? 0 : 1;
+}